@@ -42,7 +42,8 @@ typedef unsigned spinlock_data_t;
 /* Atomic operations on spinlock_data_t */
 void spinlock_data_set(volatile spinlock_data_t *sd, unsigned val);
 spinlock_data_t spinlock_data_get(volatile spinlock_data_t *sd);
-spinlock_data_t spinlock_data_testandset(volatile spinlock_data_t *sd);
+spinlock_data_t spinlock_data_fetchadd(volatile spinlock_data_t *sd,
+				       unsigned val);
 
 ////////////////////////////////////////////////////////////
 
@@ -62,34 +63,30 @@ spinlock_data_get(volatile spinlock_data_t *sd)
 
 SPINLOCK_INLINE
 spinlock_data_t
-spinlock_data_testandset(volatile spinlock_data_t *sd)
+spinlock_data_fetchadd(volatile spinlock_data_t *sd, unsigned val)
 {
 	spinlock_data_t x;
 	spinlock_data_t y;
 
 	/*
-	 * Test-and-set using LL/SC.
+	 * Atomic fetch-and-add using LL/SC.
 	 *
-	 * Load the existing value into X, and use Y to store 1.
-	 * After the SC, Y contains 1 if the store succeeded,
-	 * 0 if it failed.
-	 *
-	 * On failure, return 1 to pretend that the spinlock
-	 * was already held.
+	 * Load the existing value into X, store X+VAL; Y is nonzero
+	 * afterwards if the store succeeded. A failed SC means
+	 * somebody else got in between, so retry until it goes
+	 * through. Returns the old value.
 	 */
-
-	y = 1;
-	__asm volatile(
-		".set push;"		/* save assembler mode */
-		".set mips32;"		/* allow MIPS32 instructions */
-		".set volatile;"	/* avoid unwanted optimization */
-		"ll %0, 0(%2);"		/*   x = *sd */
-		"sc %1, 0(%2);"		/*   *sd = y; y = success? */
-		".set pop"		/* restore assembler mode */
-		: "=r" (x), "+r" (y) : "r" (sd));
-	if (y == 0) {
-		return 1;
-	}
+	do {
+		__asm volatile(
+			".set push;"		/* save assembler mode */
+			".set mips32;"		/* allow MIPS32 instructions */
+			".set volatile;"	/* avoid unwanted optimization */
+			"ll %0, 0(%2);"		/*   x = *sd */
+			"addu %1, %0, %3;"	/*   y = x + val */
+			"sc %1, 0(%2);"		/*   *sd = y; y = success? */
+			".set pop"		/* restore assembler mode */
+			: "=&r" (x), "=&r" (y) : "r" (sd), "r" (val));
+	} while (y == 0);
 	return x;
 }
 
@@ -39,10 +39,9 @@
 #include <vm.h>
 #include <mainbus.h>
 #include <syscall.h>
-#include "opt-A3.h"
-#include <addrspace.h>
 #include <proc.h>
-#include <kern/wait.h>
+#include "opt-A2.h"
+#include "opt-A3.h"
 
 /* in exception.S */
 extern void asm_usermode(struct trapframe *tf);
@@ -117,36 +116,11 @@ kill_curthread(vaddr_t epc, unsigned code, vaddr_t vaddr)
 
 #if OPT_A3
 
-	// copy from sys__exit
-
-	struct addrspace *as;
-	struct proc *p = curproc;
-
-	KASSERT(curproc->p_addrspace != NULL);
-	as_deactivate();
-	/*
-	 * clear p_addrspace before calling as_destroy. Otherwise if
-	 * as_destroy sleeps (which is quite possible) when we
-	 * come back we'll be calling as_activate on a
-	 * half-destroyed address space. This tends to be
-	 * messily fatal.
-	 */
-	as = curproc_setas(NULL);
-	as_destroy(as);
-
-	/* detach this thread from its process */
-	/* note: curproc cannot be used after this call */
-	proc_remthread(curthread);
-
-	// save for parent wait
-	p->exit_status = _MKWAIT_SIG(sig);
-
-	/* if this is the last user process in the system, proc_destroy()
-		 will wake up the kernel menu thread */
-	proc_destroy(p);
-	thread_exit();
-	/* thread_exit() does not return, so we should never get here */
-	panic("return from thread_exit in sys_exit\n");
+	// same as _exit, except the parent sees the signal; this goes
+	// through the normal exit path so the parent can still wait
+	proc_exitsig(sig);
+	/* proc_exitsig() does not return, so we should never get here */
+	panic("return from proc_exitsig in kill_curthread\n");
 
 
 #endif
@@ -180,6 +154,11 @@ mips_trap(struct trapframe *tf)
 
 	KASSERT(code < NTRAPCODES);
 
+	/* Whatever ran up to now was the user program */
+	if (!iskern) {
+		thread_chargetime(true);
+	}
+
 	/* Make sure we haven't run off our stack */
 	if (curthread != NULL && curthread->t_stack != NULL) {
 		KASSERT((vaddr_t)tf > (vaddr_t)curthread->t_stack);
@@ -233,6 +212,18 @@ mips_trap(struct trapframe *tf)
 		}
 
 		curthread->t_in_interrupt = old_in;
+#if OPT_A2
+		/*
+		 * Another thread has ended the process (see done
+		 * below). Sync up the interrupt state first, as for
+		 * the other traps.
+		 */
+		if (!iskern && curproc->p_exiting) {
+			spl = splhigh();
+			splx(spl);
+			goto done;
+		}
+#endif
 		goto done2;
 	}
 
@@ -353,6 +344,16 @@ mips_trap(struct trapframe *tf)
 	panic("I can't handle this... I think I'll just die now...\n");
 
  done:
+#if OPT_A2
+	/*
+	 * If another thread has ended the process (_exit or a fatal
+	 * signal) while we were in the kernel, leave now rather than
+	 * going back to user mode.
+	 */
+	if (!iskern) {
+		proc_checkexit();
+	}
+#endif
 	/*
 	 * Turn interrupts off on the processor, without affecting the
 	 * stored interrupt state.
@@ -370,6 +371,11 @@ mips_trap(struct trapframe *tf)
 		return;
 	}
 
+	/* Handling the trap was kernel time */
+	if (!iskern) {
+		thread_chargetime(false);
+	}
+
 	cputhreads[curcpu->c_number] = (vaddr_t)curthread;
 	cpustacks[curcpu->c_number] = (vaddr_t)curthread->t_stack + STACK_SIZE;
 
@@ -415,6 +421,8 @@ mips_usermode(struct trapframe *tf)
 	spl0();
 	cpu_irqoff();
 
+	thread_chargetime(false);
+
 	cputhreads[curcpu->c_number] = (vaddr_t)curthread;
 	cpustacks[curcpu->c_number] = (vaddr_t)curthread->t_stack + STACK_SIZE;
 
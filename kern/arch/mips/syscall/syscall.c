@@ -31,7 +31,11 @@
 #include <kern/errno.h>
 #include <kern/syscall.h>
 #include <lib.h>
+#include <endian.h>
+#include <copyinout.h>
+#include <mips/specialreg.h>
 #include <mips/trapframe.h>
+#include <cpu.h>
 #include <thread.h>
 #include <current.h>
 #include <syscall.h>
@@ -75,18 +79,427 @@
  * values) further arguments must be fetched from the user-level
  * stack, starting at sp+16 to skip over the slots for the
  * registerized values, with copyin().
+ *
+ * Dispatch is by table, indexed by call number. Each entry has the
+ * call's name, how many 32-bit words of arguments it has on the
+ * stack, and a handler that picks its arguments out of the trapframe
+ * (and the stack words, which the dispatcher has already copied in)
+ * and calls the sys_ function. Every call is timed and counted; see
+ * syscallstats.c.
+ */
+
+/* Most calls have at most this many words on the stack */
+#define SYSCALL_MAXSTACK 2
+
+typedef int (*syscall_handler)(struct trapframe *tf, const uint32_t *stack,
+			       int32_t *retval);
+
+struct syscall_desc {
+	const char *sd_name;
+	unsigned sd_nstack;		/* 32-bit argument words at sp+16 */
+	syscall_handler sd_handler;
+};
+
+static
+int
+sc_reboot(struct trapframe *tf, const uint32_t *stack, int32_t *retval)
+{
+	(void)stack; (void)retval;
+	return sys_reboot(tf->tf_a0);
+}
+
+static
+int
+sc_time(struct trapframe *tf, const uint32_t *stack, int32_t *retval)
+{
+	(void)stack; (void)retval;
+	return sys___time((userptr_t)tf->tf_a0, (userptr_t)tf->tf_a1);
+}
+
+static
+int
+sc_futex_wait(struct trapframe *tf, const uint32_t *stack, int32_t *retval)
+{
+	(void)stack; (void)retval;
+	return sys_futex_wait((userptr_t)tf->tf_a0, (int)tf->tf_a1);
+}
+
+static
+int
+sc_futex_wake(struct trapframe *tf, const uint32_t *stack, int32_t *retval)
+{
+	(void)stack;
+	return sys_futex_wake((userptr_t)tf->tf_a0, (int)tf->tf_a1, retval);
+}
+
+static
+int
+sc_getrusage(struct trapframe *tf, const uint32_t *stack, int32_t *retval)
+{
+	(void)stack; (void)retval;
+	return sys_getrusage((int)tf->tf_a0, (userptr_t)tf->tf_a1);
+}
+
+#ifdef UW
+static
+int
+sc_write(struct trapframe *tf, const uint32_t *stack, int32_t *retval)
+{
+	(void)stack;
+	return sys_write((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+			 (int)tf->tf_a2, (int *)retval);
+}
+
+static
+int
+sc_exit(struct trapframe *tf, const uint32_t *stack, int32_t *retval)
+{
+	(void)stack; (void)retval;
+	sys__exit((int)tf->tf_a0);
+	/* sys__exit does not return, execution should not get here */
+	panic("unexpected return from sys__exit");
+	return 0;
+}
+
+static
+int
+sc_getpid(struct trapframe *tf, const uint32_t *stack, int32_t *retval)
+{
+	(void)tf; (void)stack;
+	return sys_getpid((pid_t *)retval);
+}
+
+static
+int
+sc_waitpid(struct trapframe *tf, const uint32_t *stack, int32_t *retval)
+{
+	(void)stack;
+	return sys_waitpid((pid_t)tf->tf_a0, (userptr_t)tf->tf_a1,
+			   (int)tf->tf_a2, (pid_t *)retval);
+}
+
+#if OPT_A2
+static
+int
+sc_fork(struct trapframe *tf, const uint32_t *stack, int32_t *retval)
+{
+	(void)stack;
+	return sys_fork(tf, (pid_t *)retval);
+}
+
+static
+int
+sc_execv(struct trapframe *tf, const uint32_t *stack, int32_t *retval)
+{
+	(void)stack; (void)retval;
+	return sys_execv((userptr_t)tf->tf_a0, (userptr_t)tf->tf_a1);
+}
+
+static
+int
+sc_spawn(struct trapframe *tf, const uint32_t *stack, int32_t *retval)
+{
+	(void)stack;
+	return sys___spawn((userptr_t)tf->tf_a0, (userptr_t)tf->tf_a1,
+			   (pid_t)tf->tf_a2, (pid_t *)retval);
+}
+
+static
+int
+sc_thread_create(struct trapframe *tf, const uint32_t *stack,
+		 int32_t *retval)
+{
+	(void)stack;
+	return sys___thread_create(tf, (userptr_t)tf->tf_a0,
+				   (userptr_t)tf->tf_a1,
+				   (userptr_t)tf->tf_a2,
+				   (userptr_t)tf->tf_a3,
+				   (int *)retval);
+}
+
+static
+int
+sc_thread_join(struct trapframe *tf, const uint32_t *stack, int32_t *retval)
+{
+	(void)stack; (void)retval;
+	return sys_thread_join((int)tf->tf_a0, (userptr_t)tf->tf_a1);
+}
+
+static
+int
+sc_thread_exit(struct trapframe *tf, const uint32_t *stack, int32_t *retval)
+{
+	(void)stack; (void)retval;
+	sys_thread_exit((int)tf->tf_a0);
+	panic("unexpected return from sys_thread_exit");
+	return 0;
+}
+
+static
+int
+sc_procinfo(struct trapframe *tf, const uint32_t *stack, int32_t *retval)
+{
+	(void)stack; (void)retval;
+	return sys_procinfo((pid_t)tf->tf_a0, (userptr_t)tf->tf_a1);
+}
+
+static
+int
+sc_getpgid(struct trapframe *tf, const uint32_t *stack, int32_t *retval)
+{
+	(void)stack;
+	return sys_getpgid((pid_t)tf->tf_a0, (pid_t *)retval);
+}
+
+static
+int
+sc_setpgid(struct trapframe *tf, const uint32_t *stack, int32_t *retval)
+{
+	(void)stack; (void)retval;
+	return sys_setpgid((pid_t)tf->tf_a0, (pid_t)tf->tf_a1);
+}
+
+static
+int
+sc_open(struct trapframe *tf, const uint32_t *stack, int32_t *retval)
+{
+	(void)stack;
+	return sys_open((userptr_t)tf->tf_a0, (int)tf->tf_a1,
+			(mode_t)tf->tf_a2, (int *)retval);
+}
+
+static
+int
+sc_read(struct trapframe *tf, const uint32_t *stack, int32_t *retval)
+{
+	(void)stack;
+	return sys_read((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+			(size_t)tf->tf_a2, (int *)retval);
+}
+
+/*
+ * pread and pwrite: fd, buffer, and length take a0-a2, which leaves
+ * no aligned register pair for the 64-bit offset, so it's on the
+ * stack at sp+16.
+ */
+static
+int
+sc_pread(struct trapframe *tf, const uint32_t *stack, int32_t *retval)
+{
+	uint64_t pos;
+
+	join32to64(stack[0], stack[1], &pos);
+	return sys_pread((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+			 (size_t)tf->tf_a2, (off_t)pos, (int *)retval);
+}
+
+static
+int
+sc_pwrite(struct trapframe *tf, const uint32_t *stack, int32_t *retval)
+{
+	uint64_t pos;
+
+	join32to64(stack[0], stack[1], &pos);
+	return sys_pwrite((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+			  (size_t)tf->tf_a2, (off_t)pos, (int *)retval);
+}
+
+static
+int
+sc_readv(struct trapframe *tf, const uint32_t *stack, int32_t *retval)
+{
+	(void)stack;
+	return sys_readv((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+			 (int)tf->tf_a2, (int *)retval);
+}
+
+static
+int
+sc_writev(struct trapframe *tf, const uint32_t *stack, int32_t *retval)
+{
+	(void)stack;
+	return sys_writev((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+			  (int)tf->tf_a2, (int *)retval);
+}
+
+/*
+ * copy_file_range has six arguments; the last two, the length and
+ * flags, are on the stack at sp+16 and sp+20.
+ */
+static
+int
+sc_copy_file_range(struct trapframe *tf, const uint32_t *stack,
+		   int32_t *retval)
+{
+	return sys_copy_file_range((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+				   (int)tf->tf_a2, (userptr_t)tf->tf_a3,
+				   (size_t)stack[0], (unsigned)stack[1],
+				   (int *)retval);
+}
+
+static
+int
+sc_fsync(struct trapframe *tf, const uint32_t *stack, int32_t *retval)
+{
+	(void)stack; (void)retval;
+	return sys_fsync((int)tf->tf_a0);
+}
+
+static
+int
+sc_ring_enter(struct trapframe *tf, const uint32_t *stack, int32_t *retval)
+{
+	(void)stack;
+	return sys_ring_enter((userptr_t)tf->tf_a0, (unsigned)tf->tf_a1,
+			      (int *)retval);
+}
+
+/*
+ * aio_read and aio_write take their 64-bit position from the stack,
+ * the same as pread and pwrite.
  */
+static
+int
+sc_aio_read(struct trapframe *tf, const uint32_t *stack, int32_t *retval)
+{
+	uint64_t pos;
+
+	join32to64(stack[0], stack[1], &pos);
+	return sys_aio_read((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+			    (size_t)tf->tf_a2, (off_t)pos, (int *)retval);
+}
+
+static
+int
+sc_aio_write(struct trapframe *tf, const uint32_t *stack, int32_t *retval)
+{
+	uint64_t pos;
+
+	join32to64(stack[0], stack[1], &pos);
+	return sys_aio_write((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+			     (size_t)tf->tf_a2, (off_t)pos, (int *)retval);
+}
+
+static
+int
+sc_aio_wait(struct trapframe *tf, const uint32_t *stack, int32_t *retval)
+{
+	(void)stack;
+	return sys_aio_wait((int)tf->tf_a0, (int *)retval);
+}
+
+static
+int
+sc_close(struct trapframe *tf, const uint32_t *stack, int32_t *retval)
+{
+	(void)stack; (void)retval;
+	return sys_close((int)tf->tf_a0);
+}
+
+/*
+ * lseek has a 64-bit argument and return value: the position is in
+ * the aligned register pair a2/a3, whence is on the stack at sp+16,
+ * and the result goes back in v0/v1. *retval gets the v0 half; the
+ * v1 half is stored directly.
+ */
+static
+int
+sc_lseek(struct trapframe *tf, const uint32_t *stack, int32_t *retval)
+{
+	uint64_t pos;
+	off_t newpos;
+	uint32_t v0, v1;
+	int err;
+
+	join32to64(tf->tf_a2, tf->tf_a3, &pos);
+	err = sys_lseek((int)tf->tf_a0, (off_t)pos, (int)stack[0], &newpos);
+	if (err) {
+		return err;
+	}
+	split64to32((uint64_t)newpos, &v0, &v1);
+	*retval = v0;
+	tf->tf_v1 = v1;
+	return 0;
+}
+
+static
+int
+sc_dup2(struct trapframe *tf, const uint32_t *stack, int32_t *retval)
+{
+	(void)stack;
+	return sys_dup2((int)tf->tf_a0, (int)tf->tf_a1, (int *)retval);
+}
+#endif // OPT_A2
+#endif // UW
+
+static const struct syscall_desc syscall_table[SYSCALL_NUMS] = {
+	[SYS_reboot] =		{ "reboot",		0, sc_reboot },
+	[SYS___time] =		{ "__time",		0, sc_time },
+	[SYS_futex_wait] =	{ "futex_wait",		0, sc_futex_wait },
+	[SYS_futex_wake] =	{ "futex_wake",		0, sc_futex_wake },
+	[SYS_getrusage] =	{ "getrusage",		0, sc_getrusage },
+#ifdef UW
+	[SYS_write] =		{ "write",		0, sc_write },
+	[SYS__exit] =		{ "_exit",		0, sc_exit },
+	[SYS_getpid] =		{ "getpid",		0, sc_getpid },
+	[SYS_waitpid] =		{ "waitpid",		0, sc_waitpid },
+#if OPT_A2
+	[SYS_fork] =		{ "fork",		0, sc_fork },
+	[SYS_execv] =		{ "execv",		0, sc_execv },
+	[SYS___spawn] =		{ "__spawn",		0, sc_spawn },
+	[SYS___thread_create] =	{ "__thread_create",	0, sc_thread_create },
+	[SYS_thread_join] =	{ "thread_join",	0, sc_thread_join },
+	[SYS_thread_exit] =	{ "thread_exit",	0, sc_thread_exit },
+	[SYS_procinfo] =	{ "procinfo",		0, sc_procinfo },
+	[SYS_getpgid] =		{ "getpgid",		0, sc_getpgid },
+	[SYS_setpgid] =		{ "setpgid",		0, sc_setpgid },
+	[SYS_open] =		{ "open",		0, sc_open },
+	[SYS_read] =		{ "read",		0, sc_read },
+	[SYS_pread] =		{ "pread",		2, sc_pread },
+	[SYS_pwrite] =		{ "pwrite",		2, sc_pwrite },
+	[SYS_readv] =		{ "readv",		0, sc_readv },
+	[SYS_writev] =		{ "writev",		0, sc_writev },
+	[SYS_copy_file_range] =	{ "copy_file_range",	2, sc_copy_file_range },
+	[SYS_fsync] =		{ "fsync",		0, sc_fsync },
+	[SYS_ring_enter] =	{ "ring_enter",		0, sc_ring_enter },
+	[SYS_aio_read] =	{ "aio_read",		2, sc_aio_read },
+	[SYS_aio_write] =	{ "aio_write",		2, sc_aio_write },
+	[SYS_aio_wait] =	{ "aio_wait",		0, sc_aio_wait },
+	[SYS_close] =		{ "close",		0, sc_close },
+	[SYS_lseek] =		{ "lseek",		1, sc_lseek },
+	[SYS_dup2] =		{ "dup2",		0, sc_dup2 },
+#endif // OPT_A2
+#endif // UW
+};
+
+const char *
+syscall_name(int callno)
+{
+	if (callno < 0 || callno >= SYSCALL_NUMS ||
+	    syscall_table[callno].sd_name == NULL) {
+		return "unknown";
+	}
+	return syscall_table[callno].sd_name;
+}
+
 void
 syscall(struct trapframe *tf)
 {
+	const struct syscall_desc *sd;
+	uint32_t stack[SYSCALL_MAXSTACK];
+	uint32_t start;
 	int callno;
 	int32_t retval;
 	int err;
 
+	/* the table must reach the highest call number */
+	COMPILE_ASSERT(SYS_aio_wait < SYSCALL_NUMS);
+
 	KASSERT(curthread != NULL);
 	KASSERT(curthread->t_curspl == 0);
 	KASSERT(curthread->t_iplhigh_count == 0);
 
+	start = cpu_getcycles();
 	callno = tf->tf_v0;
 
 	/*
@@ -100,53 +513,27 @@ syscall(struct trapframe *tf)
 
 	retval = 0;
 
-	switch (callno) {
-	    case SYS_reboot:
-		err = sys_reboot(tf->tf_a0);
-		break;
-
-	    case SYS___time:
-		err = sys___time((userptr_t)tf->tf_a0,
-				 (userptr_t)tf->tf_a1);
-		break;
-#ifdef UW
-	case SYS_write:
-	  err = sys_write((int)tf->tf_a0,
-			  (userptr_t)tf->tf_a1,
-			  (int)tf->tf_a2,
-			  (int *)(&retval));
-	  break;
-#if OPT_A2
-	case SYS_fork:
-		err = sys_fork(tf, (pid_t *)&retval);
-		break;
-	case SYS_execv:
-		err = sys_execv((userptr_t)tf->tf_a0,
-										(userptr_t)tf->tf_a1);
-		break;
-#endif // OPT_A2
-	case SYS__exit:
-	  sys__exit((int)tf->tf_a0);
-	  /* sys__exit does not return, execution should not get here */
-	  panic("unexpected return from sys__exit");
-	  break;
-	case SYS_getpid:
-	  err = sys_getpid((pid_t *)&retval);
-	  break;
-	case SYS_waitpid:
-	  err = sys_waitpid((pid_t)tf->tf_a0,
-			    (userptr_t)tf->tf_a1,
-			    (int)tf->tf_a2,
-			    (pid_t *)&retval);
-	  break;
-#endif // UW
-
-	    /* Add stuff here */
+	sd = NULL;
+	if (callno >= 0 && callno < SYSCALL_NUMS &&
+	    syscall_table[callno].sd_handler != NULL) {
+		sd = &syscall_table[callno];
+	}
 
-	default:
-	  kprintf("Unknown syscall %d\n", callno);
-	  err = ENOSYS;
-	  break;
+	if (sd == NULL) {
+		kprintf("Unknown syscall %d\n", callno);
+		err = ENOSYS;
+	}
+	else {
+		KASSERT(sd->sd_nstack <= SYSCALL_MAXSTACK);
+		err = 0;
+		if (sd->sd_nstack > 0) {
+			err = copyin((const_userptr_t)(tf->tf_sp + 16), stack,
+				     sd->sd_nstack * sizeof(uint32_t));
+		}
+		if (!err) {
+			err = sd->sd_handler(tf, stack, &retval);
+		}
+		syscallstats_record(callno, err, cpu_getcycles() - start);
 	}
 
 
@@ -203,3 +590,24 @@ enter_forked_process(struct trapframe *tf)
 	(void)tf
 #endif
 }
+
+/*
+ * Enter user mode in a thread made by thread_create. TF is a kmalloc'd
+ * trapframe set up by sys___thread_create; copy it onto our own stack
+ * (mips_usermode insists) and free it.
+ */
+void
+enter_new_thread(void *tf, unsigned long uthread)
+{
+#if OPT_A2
+	struct trapframe local_tf = *(struct trapframe *)tf;
+
+	kfree(tf);
+	curthread->t_uthread = (struct uthread *)uthread;
+	local_tf.tf_status = CST_IRQMASK | CST_IEp | CST_KUp;
+	mips_usermode(&local_tf);
+#else
+	(void)tf;
+	(void)uthread;
+#endif
+}
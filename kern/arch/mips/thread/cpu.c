@@ -223,6 +223,18 @@ cpu_idle(void)
         cpu_irqonoff();
 }
 
+/*
+ * Read the cycle counter (coprocessor 0 register 9, "count").
+ */
+uint32_t
+cpu_getcycles(void)
+{
+	uint32_t x;
+
+	__asm volatile("mfc0 %0,$9" : "=r" (x));
+	return x;
+}
+
 /*
  * Halt the CPU permanently.
  */
@@ -84,6 +84,8 @@ struct CoreMap core_map = {0, 0, NULL, false};
 void
 vm_bootstrap(void)
 {
+	spinlock_stats_register(&stealmem_lock, "coremap");
+
 #if OPT_A3
 
 	paddr_t lo, hi;
@@ -59,7 +59,11 @@ struct cpu {
 	 */
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
+	struct threadlist c_threadcache; /* Reaped threads for reuse */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
+	uint64_t c_idlecycles;		/* Cycles spent in cpu_idle() */
+	unsigned c_idleperiods;		/* Number of times we went idle */
+	unsigned c_idlesince;		/* c_hardclocks at last stats reset */
 
 	/*
 	 * Accessed by other cpus.
@@ -69,6 +73,13 @@ struct cpu {
 	struct threadlist c_runqueue;	/* Run queue for this cpu */
 	struct spinlock c_runqueue_lock;
 
+	/*
+	 * Accessed by other cpus.
+	 * Lock-free: pushed onto with atomic_cas_ptr by any cpu,
+	 * drained into c_runqueue only by this one.
+	 */
+	struct thread *volatile c_inbox; /* Wakeups not yet on c_runqueue */
+
 	/*
 	 * Accessed by other cpus.
 	 * Protected by the IPI lock.
@@ -139,6 +150,19 @@ void cpu_irqon(void);
 void cpu_idle(void);
 void cpu_halt(void);
 
+/*
+ * Read the processor's cycle counter. It is only 32 bits wide and
+ * wraps around, so only the difference between two nearby readings
+ * (computed with unsigned arithmetic) is meaningful.
+ */
+uint32_t cpu_getcycles(void);
+
+/*
+ * Cycle counter rate. The counter runs at the processor clock, which
+ * is 25 MHz in System/161's default configuration.
+ */
+#define CPU_CYCLES_PER_SEC 25000000
+
 /*
  * Interprocessor interrupts.
  *
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _FILETABLE_H_
+#define _FILETABLE_H_
+
+/*
+ * Open files and per-process file descriptor tables.
+ *
+ * An openfile is what open() creates: a vnode plus the access mode
+ * and the seek position. Descriptors refer to openfiles, and several
+ * descriptors (from dup2, or from fork, which copies the table) can
+ * share one, and with it the seek position, as in Unix. Openfiles are
+ * reference counted and the vnode is closed when the last reference
+ * goes away. I/O holds of_offsetlock so that users of a shared seek
+ * position don't trample each other; files that can't seek, like the
+ * console, have no position and skip the lock.
+ *
+ * Functions:
+ *     openfile_open    - open a path (a kernel string) as a new openfile.
+ *     openfile_incref  - add a reference.
+ *     openfile_decref  - drop a reference; closes the file at zero.
+ *
+ *     filetable_create  - make an empty table.
+ *     filetable_copy    - make a table sharing all of another's files.
+ *     filetable_destroy - drop all of a table's files and free it.
+ *     filetable_get     - look up a descriptor. Returns the openfile
+ *                         with a reference the caller must drop, so a
+ *                         close in another thread can't pull it away.
+ *     filetable_place   - put a file at the lowest free descriptor.
+ *     filetable_placeat - put a file at a given descriptor, handing
+ *                         back whatever was there.
+ *     filetable_remove  - take a file out of the table (for close).
+ *
+ * The table functions take over the caller's reference when placing
+ * and hand it back when removing. The table has its own spinlock, so
+ * threads in one process can use it concurrently.
+ */
+
+#include <limits.h>
+#include <spinlock.h>
+
+struct vnode;
+struct lock;
+
+struct openfile {
+	struct vnode *of_vnode;
+	int of_accmode;			/* O_RDONLY, O_WRONLY, or O_RDWR */
+	bool of_append;			/* O_APPEND */
+	bool of_seekable;		/* no seek position if not */
+	struct lock *of_offsetlock;	/* held across I/O; protects: */
+	off_t of_offset;
+	struct spinlock of_reflock;	/* protects: */
+	unsigned of_refcount;
+};
+
+struct filetable {
+	struct spinlock ft_lock;
+	struct openfile *ft_files[OPEN_MAX];
+};
+
+int openfile_open(char *path, int openflags, mode_t mode,
+		  struct openfile **ret);
+void openfile_incref(struct openfile *of);
+void openfile_decref(struct openfile *of);
+
+struct filetable *filetable_create(void);
+int filetable_copy(struct filetable *src, struct filetable **ret);
+void filetable_destroy(struct filetable *ft);
+int filetable_get(struct filetable *ft, int fd, struct openfile **ret);
+int filetable_place(struct filetable *ft, struct openfile *of, int *fd);
+int filetable_placeat(struct filetable *ft, struct openfile *of, int fd,
+		      struct openfile **oldret);
+int filetable_remove(struct filetable *ft, int fd, struct openfile **ret);
+
+#endif /* _FILETABLE_H_ */
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_PROCINFO_H_
+#define _KERN_PROCINFO_H_
+
+/*
+ * Process information returned by the procinfo() system call, for
+ * ps and the like. Needs <kern/time.h> for struct timeval.
+ *
+ * procinfo(pid, &info) fills in INFO for the process with the lowest
+ * pid that is at least PID, so a caller can list every process by
+ * starting at 0 and asking again from pi_pid + 1 until it fails with
+ * ESRCH.
+ */
+
+#define PROCINFO_NAMELEN 32
+
+struct procinfo {
+	__pid_t pi_pid;			/* Process id */
+	__pid_t pi_ppid;		/* Parent's process id */
+	int pi_exited;			/* Exited, not yet cleaned up */
+	unsigned pi_nthreads;		/* Threads still in the process */
+	struct timeval pi_utime;	/* Time in user mode */
+	struct timeval pi_stime;	/* Time in the kernel */
+	struct timeval pi_waittime;	/* Time runnable but not running */
+	__counter_t pi_nvcsw;		/* Voluntary context switches */
+	__counter_t pi_nivcsw;		/* Involuntary ditto */
+	char pi_name[PROCINFO_NAMELEN];	/* Program name (may be cut off) */
+};
+
+
+#endif /* _KERN_PROCINFO_H_ */
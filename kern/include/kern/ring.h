@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_RING_H_
+#define _KERN_RING_H_
+
+/*
+ * Submission ring for batching I/O system calls.
+ *
+ * A process fills in submission entries at sq_tail and calls
+ * ring_enter(), which carries out as many as it can (up to the count
+ * asked for, and as many as there is completion room for), in order,
+ * with one trap for the lot. Each one gets a completion entry at
+ * cq_tail with the submission's user_data and its result: what the
+ * matching system call would have returned, or -errno if it failed.
+ * ring_enter returns how many submissions it took.
+ *
+ * The indexes run freely and wrap; an entry's slot is its index
+ * modulo RING_ENTRIES. The process only ever writes sq_tail and
+ * cq_head, the kernel only sq_head and cq_tail.
+ */
+
+#define RING_ENTRIES	32		/* must be a power of 2 */
+
+/* Operations */
+#define RING_NOP	0
+#define RING_READ	1		/* read, or pread at rs_off */
+#define RING_WRITE	2		/* write, or pwrite at rs_off */
+#define RING_FSYNC	3
+
+/* rs_off for read/write at the seek position */
+#define RING_OFF_CUR	((__off_t)-1)
+
+struct ring_sqe {
+	__off_t rs_off;			/* position, or RING_OFF_CUR */
+	int rs_op;			/* RING_* */
+	int rs_fd;
+#ifdef _KERNEL
+	userptr_t rs_buf;
+#else
+	void *rs_buf;
+#endif
+	__size_t rs_len;
+	unsigned rs_user_data;		/* handed back in the completion */
+};
+
+struct ring_cqe {
+	unsigned rc_user_data;
+	int rc_res;			/* result, or -errno */
+};
+
+struct ring_index {
+	unsigned sq_head;		/* next for the kernel to take */
+	unsigned sq_tail;		/* next for the process to fill */
+	unsigned cq_head;		/* next for the process to read */
+	unsigned cq_tail;		/* next for the kernel to fill */
+};
+
+struct ring {
+	struct ring_index r_idx;
+	struct ring_sqe r_sq[RING_ENTRIES];
+	struct ring_cqe r_cq[RING_ENTRIES];
+};
+
+#endif /* _KERN_RING_H_ */
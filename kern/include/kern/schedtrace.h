@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_SCHEDTRACE_H_
+#define _KERN_SCHEDTRACE_H_
+
+/*
+ * Scheduler trace file format, shared between the kernel (which
+ * writes it; see the "st" menu command) and the host-side decoder
+ * in user/sbin/schedtrace.
+ *
+ * The file is a struct schedtrace_header followed by sh_ncpus
+ * blocks of records, one block per cpu, oldest record first. Each
+ * block starts with a uint32_t count of the records in it. All
+ * fields are in the kernel's byte order, i.e. big-endian.
+ *
+ * Timestamps are the low 32 bits of the recording cpu's own cycle
+ * counter. Each cpu has a separate counter and they are not kept in
+ * step, so differences are only meaningful between records in the
+ * same cpu's block; comparing times across cpus (including wakeups
+ * and migrations that cross cpus) is approximate at best. The
+ * counters wrap, so the decoder works backwards from sh_now, the
+ * writing cpu's counter reading when the trace was written.
+ */
+
+#define SCHEDTRACE_MAGIC	0x53545231	/* "STR1" */
+
+struct schedtrace_header {
+	uint32_t sh_magic;		/* SCHEDTRACE_MAGIC */
+	uint32_t sh_ncpus;		/* Number of per-cpu blocks */
+	uint32_t sh_cyclehz;		/* Cycle counter frequency */
+	uint32_t sh_now;		/* Cycle counter at dump time */
+};
+
+/* Event types (sr_type) */
+#define STE_SWITCH	1	/* sr_thread switched out for sr_arg */
+#define STE_WAKE	2	/* sr_thread made runnable on cpu sr_aux */
+#define STE_MIGRATE	3	/* sr_thread moved to cpu sr_aux */
+#define STE_IDLE	4	/* cpu went idle */
+#define STE_UNIDLE	5	/* cpu came back from idle */
+
+/*
+ * What the outgoing thread did, in sr_aux for STE_SWITCH. These are
+ * the kernel's threadstate_t values.
+ */
+#define STS_READY	1	/* outgoing thread yielded or was preempted */
+#define STS_SLEEP	2	/* outgoing thread went to sleep */
+#define STS_ZOMBIE	3	/* outgoing thread exited */
+
+struct schedtrace_record {
+	uint32_t sr_time;		/* Cycle counter */
+	uint8_t sr_type;		/* One of STE_* */
+	uint8_t sr_cpu;			/* Cpu that logged the event */
+	uint16_t sr_aux;		/* Event-specific */
+	uint32_t sr_thread;		/* Thread the event is about */
+	uint32_t sr_arg;		/* Event-specific */
+};
+
+
+#endif /* _KERN_SCHEDTRACE_H_ */
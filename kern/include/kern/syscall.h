@@ -86,7 +86,7 @@
 //#define SYS_sigaltstack 33
 //                              (resource tracking and usage)
 //#define SYS_wait4      34
-//#define SYS_getrusage  35
+#define SYS_getrusage    35
 //                              (resource limits)
 //#define SYS_getrlimit  36
 //#define SYS_setrlimit  37
@@ -94,8 +94,8 @@
 //#define SYS_getpriority 38
 //#define SYS_setpriority 39
 //                              (process groups, sessions, and job control)
-//#define SYS_getpgid    40
-//#define SYS_setpgid    41
+#define SYS_getpgid      40
+#define SYS_setpgid      41
 //#define SYS_getsid     42
 //#define SYS_setsid     43
 //                              (userlevel debugging)
@@ -109,12 +109,12 @@
 #define SYS_close        49
 #define SYS_read         50
 #define SYS_pread        51
-//#define SYS_readv      52
+#define SYS_readv        52
 //#define SYS_preadv     53
 #define SYS_getdirentry  54
 #define SYS_write        55
 #define SYS_pwrite       56
-//#define SYS_writev     57
+#define SYS_writev       57
 //#define SYS_pwritev    58
 #define SYS_lseek        59
 #define SYS_flock        60
@@ -197,6 +197,20 @@
 #define SYS_reboot       119
 //#define SYS___sysctl   120
 
+//                              -- Local extensions --
+#define SYS_futex_wait   121
+#define SYS_futex_wake   122
+#define SYS___thread_create 123
+#define SYS_thread_join  124
+#define SYS_thread_exit  125
+#define SYS_procinfo     126
+#define SYS___spawn      127
+#define SYS_copy_file_range 128
+#define SYS_ring_enter   129
+#define SYS_aio_read     130
+#define SYS_aio_write    131
+#define SYS_aio_wait     132
+
 /*CALLEND*/
 
 
@@ -72,13 +72,13 @@ struct proc {
 	/* VFS */
 	struct vnode *p_cwd;		/* current working directory */
 
+	/* CPU accounting; under p_lock */
+	struct cpuusage p_usage;	/* threads that have left */
+	struct cpuusage p_cusage;	/* children waited for */
+
 #ifdef UW
-  /* a vnode to refer to the console device */
-  /* this is a quick-and-dirty way to get console writes working */
-  /* you will probably need to change this when implementing file-related
-     system calls, since each process will need to keep track of all files
-     it has opened, not just the console. */
-  struct vnode *console;                /* a vnode for the console device */
+  /* open files, by file descriptor; see filetable.h */
+  struct filetable *p_filetable;
 #endif
 
 	/* add more material here as needed */
@@ -87,19 +87,60 @@ struct proc {
 	// points to parent process
 	// DEFAULT: 0?
  	pid_t p_pid;
-	// list of children
-	struct array* p_children;
-	// CV for wait & exit (every child is a potential parent)
+	// next in the process table's hash chain
+	struct proc* p_hashnext;
+	// process group; also the gang for gang scheduling
+	// (inherited across fork, changed by setpgid)
+	pid_t p_pgid;
+	// children: p_parent points at the parent (NULL for processes
+	// started from the menu) and holds a reference on it; the child
+	// is on the parent's p_kids list while running and moves to its
+	// p_zombies list when it exits, linked through p_sibling. All of
+	// that under the parent's p_waitlock; waitpid sleeps on
+	// p_waitcv for children to exit.
+	struct proc* p_parent;
+	struct proc* p_kids;
+	struct proc* p_zombies;
+	struct proc* p_sibling;
+	struct lock* p_waitlock;
+	struct cv* p_waitcv;
+	// references: one for whoever will reap the process (the parent
+	// or, for an orphan, itself), plus one per running child; under
+	// p_lock. The proc is destroyed when it drops to 0.
+	unsigned p_refcount;
+	// CV for thread_create/thread_join and exit
 	struct cv* p_cv;
-	// lock for cv but do we really need it??
 	struct lock* p_cv_lock;
-	// current state of the process
+	// current state of the process; under its own p_waitlock
 	pstate p_state;
-	// when exit, save for parent
+	// when exit, save for parent; under p_cv_lock
 	int exit_status;
+	// set once by _exit or a fatal signal: every thread leaves at its
+	// next return to user mode; under p_cv_lock (read unlocked on the
+	// way out of the kernel, since it never goes back to false)
+	bool p_exiting;
+	// user threads (thread_create): how many are still running,
+	// the next thread id, and records (struct uthread) for created
+	// threads that nobody has joined yet; all under p_cv_lock
+	unsigned p_nuthreads;
+	int p_nexttid;
+	struct array* p_uthreads;
+	// aio_read/aio_write requests that aio_wait hasn't collected;
+	// under the aio lock (see aio_syscalls.c)
+	struct aioreq* p_aioreqs;
 #endif // OPT_A2
 };
 
+#if OPT_A2
+// a thread made by thread_create, for thread_join
+struct uthread {
+	int ut_tid;
+	bool ut_done;       // has called thread_exit
+	bool ut_joining;    // somebody is in thread_join on it
+	int ut_value;       // thread_exit value
+};
+#endif
+
 /* This is the process structure for the kernel and for kernel-only threads. */
 extern struct proc *kproc;
 
@@ -109,19 +150,16 @@ extern struct semaphore *no_proc_sem;
 #endif // UW
 
 #if OPT_A2
-// master lock for mutual exclusion
-extern struct lock* p_table_lock;
-// array of all processes
-// CREATE: when proc is created
-// DELETE: when proc is safe to be deleted
-extern struct array* p_table;
-// used to lock children of a process
-// e.g. when killing a child and interupted by another proc,
-// this prevents from others killing the child
-extern struct lock* p_children_lock;
-// return proc corresponding to pid
+// master lock for the process table; lookups take it for reading,
+// insertions and removals for writing
+// CREATE: proc goes in the table when it is created
+// DELETE: and comes out when it is safe to be deleted
+extern struct rwlock* p_table_lock;
+// return proc corresponding to pid, or NULL
 // used in wait
-struct proc* getProc(struct array* procs, pid_t pid);
+struct proc* getProc(pid_t pid);
+// return the proc with the lowest pid >= pid, or NULL
+struct proc* nextProc(pid_t pid);
 #endif
 
 /* Call once during system startup to allocate data structures. */
@@ -133,12 +171,21 @@ struct proc *proc_create_runprogram(const char *name);
 /* Destroy a process. */
 void proc_destroy(struct proc *proc);
 
+#if OPT_A2
+/* Add or drop a reference; dropping the last one destroys the proc. */
+void proc_ref(struct proc *proc);
+void proc_unref(struct proc *proc);
+#endif
+
 /* Attach a thread to a process. Must not already have a process. */
 int proc_addthread(struct proc *proc, struct thread *t);
 
 /* Detach a thread from its process. */
 void proc_remthread(struct thread *t);
 
+/* Total CPU usage of a process's threads, past and present. */
+void proc_getusage(struct proc *proc, struct cpuusage *cu);
+
 /* Fetch the address space of the current process. */
 struct addrspace *curproc_getas(void);
 
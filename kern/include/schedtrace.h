@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _SCHEDTRACE_H_
+#define _SCHEDTRACE_H_
+
+/*
+ * Scheduler tracing. When the kernel is built with "options
+ * schedtrace", the thread system logs context switches, wakeups,
+ * migrations, and idle periods into a per-cpu ring buffer, which the
+ * "st" menu command can write out to a file for the host-side
+ * schedtrace decoder. See <kern/schedtrace.h> for the format.
+ *
+ *    schedtrace       - log an event (STE_*) about thread T. A no-op
+ *                       unless tracing has been started.
+ *    schedtrace_start - allocate (or clear) the rings and start
+ *                       logging.
+ *    schedtrace_stop  - stop logging; the rings are kept.
+ *    schedtrace_dump  - stop logging and write the rings to PATH.
+ */
+
+#include <kern/schedtrace.h>
+#include "opt-schedtrace.h"
+
+struct thread;
+
+#if OPT_SCHEDTRACE
+void schedtrace(unsigned type, struct thread *t, unsigned aux, uint32_t arg);
+int schedtrace_start(void);
+void schedtrace_stop(void);
+int schedtrace_dump(const char *path);
+#else
+#define schedtrace(type, t, aux, arg) ((void)0)
+#endif
+
+
+#endif /* _SCHEDTRACE_H_ */
@@ -36,6 +36,7 @@
  */
 
 #include <cdefs.h>
+#include "opt-spinstats.h"
 
 /* Inlining support - for making sure an out-of-line copy gets built */
 #ifndef SPINLOCK_INLINE
@@ -45,9 +46,29 @@
 /* Get the machine-dependent bits. */
 #include <machine/spinlock.h>
 
+/*
+ * Contention statistics, kept per spinlock if the kernel is built
+ * with "options spinstats". ss_hist[i] counts contended acquisitions
+ * that spun for between 2^(i-1) and 2^i - 1 backoff iterations; the
+ * last bucket collects everything longer.
+ */
+#define SPINLOCK_HISTBUCKETS 12
+
+struct spinlock_stats {
+	unsigned ss_acquires;		/* Total acquisitions. */
+	unsigned ss_contended;		/* Acquisitions that had to wait. */
+	unsigned ss_hist[SPINLOCK_HISTBUCKETS];	/* Spin time histogram. */
+};
+
 /*
  * Basic spinlock.
  *
+ * This is a ticket lock: each CPU wanting the lock takes the next
+ * number from lk_next and waits until lk_serving reaches it. This
+ * makes the lock FIFO-fair, and waiters only read lk_serving while
+ * spinning, so a release doesn't set off a stampede of atomic
+ * operations on the bus.
+ *
  * Note that spinlocks are held by CPUs, not by threads.
  *
  * This structure is made public so spinlocks do not have to be
@@ -55,14 +76,25 @@
  * the structure directly but always use the spinlock API functions.
  */
 struct spinlock {
-	volatile spinlock_data_t lk_lock; /* The memory word where we spin. */
+	volatile spinlock_data_t lk_next; /* Next ticket to hand out. */
+	volatile spinlock_data_t lk_serving; /* Ticket holding the lock. */
 	struct cpu *lk_holder;		/* CPU holding this lock. */
+#if OPT_SPINSTATS
+	struct spinlock_stats lk_stats;	/* Contention statistics. */
+#endif
 };
 
 /*
  * Initializer for cases where a spinlock needs to be static or global.
  */
-#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL }
+#if OPT_SPINSTATS
+#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, \
+				  SPINLOCK_DATA_INITIALIZER, NULL, \
+				  { 0, 0, { 0 } } }
+#else
+#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, \
+				  SPINLOCK_DATA_INITIALIZER, NULL }
+#endif
 
 /*
  * Spinlock functions.
@@ -74,6 +106,12 @@ struct spinlock {
  * release	Release the lock. May re-enable interrupts.
  *
  * do_i_hold	Check if the current CPU holds the lock.
+ *
+ * stats_register  Have stats_printall report the lock's contention
+ *		statistics under the given name (which is copied).
+ * stats_printall  Print the statistics of every registered lock.
+ *		(Neither does anything useful unless the kernel was built
+ *		with "options spinstats".)
  */
 
 void spinlock_init(struct spinlock *lk);
@@ -84,5 +122,8 @@ void spinlock_release(struct spinlock *lk);
 
 bool spinlock_do_i_hold(struct spinlock *lk);
 
+void spinlock_stats_register(struct spinlock *lk, const char *name);
+void spinlock_stats_printall(void);
+
 
 #endif /* _SPINLOCK_H_ */
@@ -36,21 +36,58 @@
 
 
 #include <spinlock.h>
+#include "opt-lockstats.h"
+
+#if OPT_LOCKSTATS
+/*
+ * Contention statistics for sleeping locks and CVs, kept if the
+ * kernel is built with "options lockstats". Every lock or CV created
+ * with the same name shares one of these, so e.g. all the per-process
+ * locks of one program show up together. Times are in cycles. The
+ * records are never freed.
+ */
+struct lockstat {
+        char *ls_name;
+        struct spinlock ls_lock;        /* protects the counters */
+        unsigned ls_acquires;           /* lock_acquire calls */
+        unsigned ls_contended;          /* ... that found it held */
+        uint64_t ls_waitcycles;         /* total time spent acquiring */
+        uint64_t ls_holdcycles;         /* total time held */
+        uint32_t ls_maxhold;            /* longest single hold */
+        unsigned ls_cvwaits;            /* cv_wait calls */
+        uint64_t ls_cvwaitcycles;       /* total time asleep in cv_wait */
+        struct lockstat *ls_next;
+};
+
+/*
+ * lockstat_print - print all records.
+ * lockstat_reset - zero all the counters.
+ */
+void lockstat_print(void);
+void lockstat_reset(void);
+#endif
 
 /*
  * Dijkstra-style semaphore.
  *
  * The name field is for easier debugging. A copy of the name is made
  * internally.
+ *
+ * A semaphore made with sem_create_fifo hands off directly: V gives
+ * its unit to the longest-waiting thread (of the highest priority)
+ * instead of adding it to the count, so sleepers are served in order
+ * and never wake up to find the unit already taken.
  */
 struct semaphore {
         char *sem_name;
 	struct wchan *sem_wchan;
 	struct spinlock sem_lock;
         volatile int sem_count;
+	bool sem_fifo;			/* V hands off to the oldest P */
 };
 
 struct semaphore *sem_create(const char *name, int initial_count);
+struct semaphore *sem_create_fifo(const char *name, int initial_count);
 void sem_destroy(struct semaphore *);
 
 /*
@@ -80,6 +117,20 @@ struct lock {
         struct wchan* wch;
         volatile bool held;
         struct thread* owner;
+        // contention counters, protected by spin
+        unsigned lk_acquires;           // total acquisitions
+        unsigned lk_contended;          // found the lock already held
+        unsigned lk_spins;              // contended, got it without sleeping
+        unsigned lk_sleeps;             // times a waiter went to sleep
+        // priority inheritance
+        unsigned lk_waiters;            // threads blocked here, under spin
+        int lk_waitprio;                // highest waiter priority, under
+                                        // the inheritance lock
+        struct lock *lk_nextheld;       // owner's t_heldlocks chain
+#if OPT_LOCKSTATS
+        struct lockstat *lk_stat;
+        uint32_t lk_acquiretime;        // cycle count when acquired
+#endif
 };
 
 struct lock *lock_create(const char *name);
@@ -88,18 +139,37 @@ void lock_acquire(struct lock *);
 /*
  * Operations:
  *    lock_acquire - Get the lock. Only one thread can hold the lock at the
- *                   same time.
+ *                   same time. If the holder is running on another CPU
+ *                   the caller spins for a bounded time before sleeping.
  *    lock_release - Free the lock. Only the thread holding the lock may do
  *                   this.
  *    lock_do_i_hold - Return true if the current thread holds the lock;
  *                   false otherwise.
  *
+ * A thread that goes to sleep in lock_acquire lends its priority to
+ * the holder, and on through whatever lock the holder is itself
+ * sleeping on, so a low-priority holder can't be starved by
+ * medium-priority threads while a high-priority thread waits. The
+ * holder drops back when it releases the lock.
+ *
  * These operations must be atomic. You get to write them.
  */
 void lock_release(struct lock *);
 bool lock_do_i_hold(struct lock *);
 void lock_destroy(struct lock *);
 
+/*
+ * Recompute curthread's effective priority from its base priority
+ * and the waiters on the locks it holds. Used by thread_setpriority.
+ */
+void lock_updatepriority(void);
+
+/*
+ * Priority inheritance can be switched off (for testing, to see the
+ * inversion it prevents). Defaults to on.
+ */
+extern bool lock_inherit_priority;
+
 
 /*
  * Condition variable.
@@ -120,6 +190,10 @@ struct cv {
         // add what you need here
         // (don't forget to mark things volatile as needed)
         struct wchan* wch;
+        bool cv_waitmorph;              // see cv_setwaitmorph
+#if OPT_LOCKSTATS
+        struct lockstat *cv_stat;
+#endif
 };
 
 struct cv *cv_create(const char *name);
@@ -142,5 +216,65 @@ void cv_wait(struct cv *cv, struct lock *lock);
 void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
 
+/*
+ * Wait morphing. With this turned on for a CV, cv_broadcast doesn't
+ * wake the sleepers up just so they can all pile onto the lock; it
+ * moves them straight onto the lock's queue (the broadcaster holds
+ * the lock, so none of them could get it yet anyway) and lock_release
+ * then wakes them one at a time. Off by default. Only use it if the
+ * CV is always used with the same lock.
+ */
+void cv_setwaitmorph(struct cv *cv, bool on);
+
+
+/*
+ * Reader-writer lock.
+ *
+ * Any number of readers may hold the lock at once, or one writer.
+ * Writers are preferred: once a writer is waiting, new readers queue
+ * up behind it. When a writer releases the lock, all readers that
+ * queued up while it was held are let in together before the next
+ * writer, so neither side can be starved. Ownership is handed off
+ * directly to the threads being woken.
+ *
+ * The name field is for easier debugging. A copy of the name is made
+ * internally.
+ */
+struct rwlock {
+        char *rwlock_name;
+        struct spinlock rw_lock;
+        struct wchan *rw_readwchan;     /* readers wait here */
+        struct wchan *rw_writewchan;    /* writers wait here */
+        volatile unsigned rw_readers;   /* readers holding the lock */
+        struct thread *rw_writer;       /* writer holding the lock */
+        volatile unsigned rw_waitreaders;  /* readers sleeping */
+        volatile unsigned rw_waitwriters;  /* writers sleeping */
+        volatile unsigned rw_readgrants;   /* wakeups handed to readers */
+        volatile bool rw_writegrant;       /* wakeup handed to a writer */
+};
+
+struct rwlock *rwlock_create(const char *name);
+void rwlock_destroy(struct rwlock *);
+
+/*
+ * Operations:
+ *    rwlock_acquire_read  - Get the lock for reading (shared).
+ *    rwlock_release_read  - Release a read hold.
+ *    rwlock_acquire_write - Get the lock for writing (exclusive).
+ *    rwlock_release_write - Release a write hold. Only the thread
+ *                           holding the lock may do this.
+ *    rwlock_do_i_hold_write - Return true if the current thread holds
+ *                           the lock for writing.
+ *
+ * The lock is not recursive; in particular a thread holding it for
+ * reading must not try to get it again, or it may deadlock behind a
+ * waiting writer.
+ */
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+bool rwlock_do_i_hold_write(struct rwlock *);
+
 
 #endif /* _SYNCH_H_ */
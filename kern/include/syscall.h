@@ -34,6 +34,8 @@
 
 
 struct trapframe; /* from <machine/trapframe.h> */
+struct proc;
+struct addrspace;
 
 /*
  * The system call dispatcher.
@@ -41,6 +43,26 @@ struct trapframe; /* from <machine/trapframe.h> */
 
 void syscall(struct trapframe *tf);
 
+/*
+ * Size of the dispatch table: one more than the highest call number
+ * in <kern/syscall.h>. When adding a call past the end, bump this and
+ * the check in syscall().
+ */
+#define SYSCALL_NUMS 133
+
+/* Name of system call CALLNO, for printing. */
+const char *syscall_name(int callno);
+
+/*
+ * Per-syscall statistics (call and error counts and latency
+ * histograms, kept per cpu), collected by the dispatcher and printed
+ * with the "sc" menu command.
+ */
+void syscallstats_bootstrap(void);
+void syscallstats_record(int callno, int err, uint32_t cycles);
+void syscallstats_print(void);
+void syscallstats_reset(void);
+
 /*
  * Support functions.
  */
@@ -48,6 +70,9 @@ void syscall(struct trapframe *tf);
 /* Helper for fork(). You write this. */
 void enter_forked_process(struct trapframe *tf);
 
+/* Helper for thread_create(): thread_fork entry point. */
+void enter_new_thread(void *tf, unsigned long uthread);
+
 /* Enter user mode. Does not return. */
 void enter_new_process(int argc, userptr_t argv, vaddr_t stackptr,
 		       vaddr_t entrypoint);
@@ -59,12 +84,53 @@ void enter_new_process(int argc, userptr_t argv, vaddr_t stackptr,
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys_futex_wait(userptr_t uaddr, int val);
+int sys_futex_wake(userptr_t uaddr, int count, int *retval);
+int sys_getrusage(int who, userptr_t usage);
+
+/* Set up the futex wait table. */
+void futex_bootstrap(void);
+/* Wake every futex sleeper in AS, for a process that is exiting. */
+void futex_wakeall(struct addrspace *as);
 
 #ifdef UW
 int sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval);
 #if OPT_A2
 int sys_fork(struct trapframe* tf, pid_t* retVal);
 int sys_execv(userptr_t progname, userptr_t args);
+int sys___spawn(userptr_t path, userptr_t args, pid_t pgid, pid_t *retval);
+int sys___thread_create(struct trapframe *tf, userptr_t entry,
+                        userptr_t func, userptr_t arg, userptr_t stack,
+                        int *retval);
+int sys_thread_join(int tid, userptr_t value);
+void sys_thread_exit(int value);
+int sys_procinfo(pid_t pid, userptr_t info);
+int sys_open(userptr_t path, int flags, mode_t mode, int *retval);
+int sys_read(int fdesc, userptr_t ubuf, size_t nbytes, int *retval);
+int sys_pread(int fdesc, userptr_t ubuf, size_t nbytes, off_t pos, int *retval);
+int sys_pwrite(int fdesc, userptr_t ubuf, size_t nbytes, off_t pos, int *retval);
+int sys_readv(int fdesc, userptr_t iov, int iovcnt, int *retval);
+int sys_writev(int fdesc, userptr_t iov, int iovcnt, int *retval);
+int sys_copy_file_range(int infd, userptr_t inoff, int outfd, userptr_t outoff,
+			size_t len, unsigned flags, int *retval);
+int sys_fsync(int fdesc);
+int sys_ring_enter(userptr_t ring, unsigned count, int *retval);
+int sys_aio_read(int fdesc, userptr_t ubuf, size_t len, off_t pos, int *retval);
+int sys_aio_write(int fdesc, userptr_t ubuf, size_t len, off_t pos, int *retval);
+int sys_aio_wait(int id, int *retval);
+/* Start the asynchronous I/O threads. */
+void aio_bootstrap(void);
+/* Wait for and drop a process's uncollected aio requests. */
+void aio_discard(struct proc *p);
+int sys_close(int fdesc);
+int sys_lseek(int fdesc, off_t pos, int whence, off_t *retval);
+int sys_dup2(int oldfd, int newfd, int *retval);
+int sys_getpgid(pid_t pid, pid_t *retval);
+int sys_setpgid(pid_t pid, pid_t pgid);
+/* Exit the current process because of fatal signal SIG (from a trap). */
+void proc_exitsig(int sig);
+/* Leave if another thread has exited the process (before user mode). */
+void proc_checkexit(void);
 #endif // OPT_A2
 void sys__exit(int exitcode);
 int sys_getpid(pid_t *retval);
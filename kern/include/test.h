@@ -57,9 +57,14 @@ int queuetest(int, char **);
 int threadtest(int, char **);
 int threadtest2(int, char **);
 int threadtest3(int, char **);
+int threadforkbench(int, char **);
+int gangtest(int, char **);
 int semtest(int, char **);
 int locktest(int, char **);
 int cvtest(int, char **);
+int locktputtest(int, char **);
+int rwtest(int, char **);
+int pitest(int, char **);
 
 #ifdef UW
 /* Another thread and synchronization test */
@@ -41,6 +41,8 @@
 #include <threadlist.h>
 
 struct cpu;
+struct lock;
+struct uthread;
 
 /* get machine-dependent defs */
 #include <machine/thread.h>
@@ -55,6 +57,20 @@ struct cpu;
 /* Macro to test if two addresses are on the same kernel stack */
 #define SAME_STACK(p1, p2)     (((p1) & STACK_MASK) == ((p2) & STACK_MASK))
 
+/* Names shorter than this are kept in the thread, not kmalloc'd */
+#define THREAD_NAMEBUF 24
+
+/* Most exited threads each cpu keeps around for thread_fork to reuse */
+#define THREAD_CACHE_MAX 16
+
+
+/*
+ * Thread priorities. Larger numbers run first; threads of equal
+ * priority are scheduled round-robin.
+ */
+#define PRI_MIN     0
+#define PRI_DEFAULT 16
+#define PRI_MAX     31
 
 /* States a thread can be in. */
 typedef enum {
@@ -64,6 +80,19 @@ typedef enum {
 	S_ZOMBIE,	/* zombie; exited but not yet deleted */
 } threadstate_t;
 
+/*
+ * CPU accounting, in cycles of the cycle counter (see cpu.h). Threads
+ * keep one of these; processes keep one for their exited threads and
+ * one for the children they have waited for.
+ */
+struct cpuusage {
+	uint64_t cu_utime;		/* Running in user mode */
+	uint64_t cu_stime;		/* Running in the kernel */
+	uint64_t cu_waittime;		/* Runnable, waiting for a cpu */
+	unsigned cu_nvcsw;		/* Slept or yielded */
+	unsigned cu_nivcsw;		/* Preempted */
+};
+
 /* Thread structure. */
 struct thread {
 	/*
@@ -71,6 +100,7 @@ struct thread {
 	 * debugger is messed up.
 	 */
 	char *t_name;			/* Name of this thread */
+	char t_namebuf[THREAD_NAMEBUF];	/* Storage for short names */
 	const char *t_wchan_name;	/* Name of wait channel, if sleeping */
 	threadstate_t t_state;		/* State this thread is in */
 
@@ -79,6 +109,7 @@ struct thread {
 	 */
 	struct thread_machdep t_machdep; /* Any machine-dependent goo */
 	struct threadlistnode t_listnode; /* Link for run/sleep/zombie lists */
+	struct thread *t_inboxnext;	/* Link for a cpu's wakeup inbox */
 	void *t_stack;			/* Kernel-level stack */
 	struct switchframe *t_context;	/* Saved register context (on stack) */
 	struct cpu *t_cpu;		/* CPU thread runs on */
@@ -101,10 +132,39 @@ struct thread {
 	int t_curspl;			/* Current spl*() state */
 	int t_iplhigh_count;		/* # of times IPL has been raised */
 
+	/*
+	 * Scheduling priority.
+	 *
+	 * t_priority is the effective priority, which can be raised
+	 * above t_basepriority by threads waiting on locks this thread
+	 * holds (see lock_acquire). t_priority and t_blockedon are
+	 * protected by the priority-inheritance lock in synch.c;
+	 * t_heldlocks is only touched by the thread itself.
+	 */
+	int t_priority;			/* Effective priority */
+	int t_basepriority;		/* Priority before donations */
+	struct lock *t_blockedon;	/* Lock we're sleeping on, if any */
+	struct lock *t_heldlocks;	/* Sleep locks we hold */
+
+	/*
+	 * CPU accounting. Time is charged from t_stamp up to each
+	 * trap entry, return to user mode, and context switch; while
+	 * the thread is on a run queue t_stamp is when it got there,
+	 * by the cycle counter of the cpu whose queue it is (the
+	 * counters aren't synchronized). Only touched by the thread
+	 * itself (and by whoever makes it runnable), with interrupts
+	 * off.
+	 */
+	struct cpuusage t_usage;
+	uint32_t t_stamp;		/* Cycle count at last charge */
+
 	/*
 	 * Public fields
 	 */
 
+	/* Record for threads made by the thread_create syscall */
+	struct uthread *t_uthread;
+
 	/* add more here as needed */
 };
 
@@ -144,6 +204,12 @@ int thread_fork(const char *name, struct proc *proc,
                 void (*func)(void *, unsigned long),
                 void *data1, unsigned long data2);
 
+/*
+ * Whether exited threads are cached per-cpu for reuse by thread_fork.
+ * Defaults to on; switch it off to measure the difference.
+ */
+extern bool thread_cache_enabled;
+
 /*
  * Cause the current thread to exit.
  * Interrupts need not be disabled.
@@ -157,6 +223,31 @@ void thread_exit(void);
  */
 void thread_yield(void);
 
+/*
+ * Set the current thread's base priority (PRI_MIN to PRI_MAX). The
+ * effective priority may stay higher while other threads are waiting
+ * for locks the current thread holds. Yields so that a ready thread
+ * of higher priority can run.
+ */
+void thread_setpriority(int priority);
+
+/*
+ * Return the number of CPUs in the system.
+ */
+unsigned thread_numcpus(void);
+
+/*
+ * Charge the current thread's time since the last charge as user
+ * time (USER true, on entry from user mode) or kernel time. Call
+ * with interrupts off.
+ */
+void thread_chargetime(bool user);
+
+/*
+ * Add the counters in SRC to DEST.
+ */
+void cpuusage_add(struct cpuusage *dest, const struct cpuusage *src);
+
 /*
  * Reshuffle the run queue. Called from the timer interrupt.
  */
@@ -168,5 +259,42 @@ void schedule(void);
  */
 void thread_consider_migration(void);
 
+/*
+ * Gang scheduling: turn it on or off (it starts off); pick the next
+ * gang to favor (called by CPU 0 from the timer interrupt); and check
+ * whether the current thread belongs to the gang being favored.
+ */
+void thread_setgangsched(bool on);
+void thread_rotategang(void);
+bool thread_ingang(void);
+
+/*
+ * Check whether a thread of higher priority than the current one is
+ * waiting on this CPU's run queue. Called from the timer interrupt.
+ */
+bool thread_higherqueued(void);
+
+/*
+ * Sort a run queue by priority, with the members of process group
+ * GANG first among equals; what schedule() does to the current CPU's
+ * queue. GANG 0 means no gang.
+ */
+void thread_gangsort(struct threadlist *tl, pid_t gang);
+
+/*
+ * Consolidation: pack threads onto as few cpus as possible while the
+ * number of running and ready threads is at or below LOAD (0, the
+ * default, means never). Checked by thread_consider_migration.
+ */
+void thread_setpackthreshold(unsigned load);
+unsigned thread_getpackthreshold(void);
+
+/*
+ * Print (or reset) per-cpu idle residency: the share of time spent
+ * in cpu_idle() and the number and average length of idle periods.
+ */
+void thread_printidlestats(void);
+void thread_resetidlestats(void);
+
 
 #endif /* _THREAD_H_ */
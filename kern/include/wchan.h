@@ -36,6 +36,7 @@
 
 
 struct wchan; /* Opaque */
+struct thread; /* from <thread.h> */
 
 /*
  * Create a wait channel. Use NAME as a symbolic name for the channel.
@@ -75,11 +76,33 @@ void wchan_sleep(struct wchan *wc);
  * Wake up one thread, or all threads, sleeping on a wait channel.
  * The queue should not already be locked.
  *
- * The current implementation is FIFO but this is not promised by the
- * interface.
+ * Sleepers are queued by priority (FIFO among equals), so wakeone
+ * normally picks the highest-priority thread; a sleeper whose
+ * priority is raised while it is asleep keeps its place, however.
+ * wchan_wakeone returns false if nobody was asleep.
  */
-void wchan_wakeone(struct wchan *wc);
+bool wchan_wakeone(struct wchan *wc);
 void wchan_wakeall(struct wchan *wc);
 
+/*
+ * Wake up a particular thread sleeping on a wait channel. The caller
+ * must know, through its own locking, that T is asleep on WC or about
+ * to be (that is, T has locked WC on its way to wchan_sleep).
+ */
+void wchan_wakethread(struct wchan *wc, struct thread *t);
+
+/*
+ * Move one sleeper from FROM to TO without waking it, and return it
+ * (or NULL if FROM has no sleepers). Neither channel should already
+ * be locked.
+ */
+struct thread *wchan_requeueone(struct wchan *from, struct wchan *to);
+
+/*
+ * Return the highest priority among the threads sleeping on the
+ * channel, or LOWEST if there are none.
+ */
+int wchan_maxpriority(struct wchan *wc, int lowest);
+
 
 #endif /* _WCHAN_H_ */
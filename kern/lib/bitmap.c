@@ -120,6 +120,54 @@ bitmap_alloc(struct bitmap *b, unsigned *index)
         return ENOSPC;
 }
 
+/*
+ * Like bitmap_alloc, but take the first clear bit at or after START,
+ * wrapping around to the beginning if need be. Handing out indexes
+ * with START just past the last one allocated keeps a freed index
+ * from being reused until all the others have been.
+ */
+int
+bitmap_alloc_from(struct bitmap *b, unsigned start, unsigned *index)
+{
+        unsigned maxix = DIVROUNDUP(b->nbits, BITS_PER_WORD);
+        unsigned ix, startix, n, offset;
+        WORD_TYPE mask;
+
+        KASSERT(start < b->nbits);
+        startix = start / BITS_PER_WORD;
+
+        /* First the rest of the word START is in */
+        for (offset = start % BITS_PER_WORD; offset < BITS_PER_WORD;
+             offset++) {
+                mask = ((WORD_TYPE)1) << offset;
+                if ((b->v[startix] & mask)==0) {
+                        b->v[startix] |= mask;
+                        *index = (startix*BITS_PER_WORD)+offset;
+                        KASSERT(*index < b->nbits);
+                        return 0;
+                }
+        }
+
+        /* Then whole words, ending back at START's word */
+        for (n=1; n<=maxix; n++) {
+                ix = (startix + n) % maxix;
+                if (b->v[ix]!=WORD_ALLBITS) {
+                        for (offset = 0; offset < BITS_PER_WORD; offset++) {
+                                mask = ((WORD_TYPE)1) << offset;
+
+                                if ((b->v[ix] & mask)==0) {
+                                        b->v[ix] |= mask;
+                                        *index = (ix*BITS_PER_WORD)+offset;
+                                        KASSERT(*index < b->nbits);
+                                        return 0;
+                                }
+                        }
+                        KASSERT(0);
+                }
+        }
+        return ENOSPC;
+}
+
 static
 inline
 void
@@ -43,12 +43,15 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <proc.h>
 #include <current.h>
 #include <addrspace.h>
 #include <vnode.h>
 #include <vfs.h>
 #include <synch.h>
+#include <bitmap.h>
+#include <filetable.h>
 #include <kern/fcntl.h>
 #include <limits.h>
 #include "opt-A2.h"
@@ -74,58 +77,91 @@ struct semaphore *no_proc_sem;
 
 #if OPT_A2
 // definitions of global vars
-struct lock* p_table_lock;
-struct array* p_table;
-struct lock* p_children_lock;
-
-// insert proc into p_table and generate unique
-static pid_t insertProc(struct array* procs, struct proc* p) {
-	unsigned int i = 0;
-	KASSERT(procs != NULL);
-
-	for (i = 0; i <= array_num(procs); i++) {
-		// if at the end of array
-		if (i == array_num(procs)) {
-			array_add(procs, p, NULL);
-			break;
-		}
-
-		struct proc* now = (struct proc*)array_get(procs, i);
-		// if empty block, fill it in
-		if (now == NULL) {
-			array_set(procs, i, p);
-			break;
-		}
+struct rwlock* p_table_lock;
+
+// The process table: a bitmap of the pids in use, plus a hash table
+// from pid to proc. Both under p_table_lock.
+//
+// New pids are searched for starting just past the last one handed
+// out, so a pid isn't reused until the whole range has gone round.
+// That keeps a stale pid (from a racing waitpid, say) from quietly
+// naming some new process, and keeps the search short: the bits
+// just past the last pid are almost always clear.
+#define PROC_HASHSIZE 256
+static struct bitmap* pid_map;
+static pid_t pid_next;
+static struct proc* p_hash[PROC_HASHSIZE];
+
+#define PROC_HASH(pid) ((unsigned)(pid) % PROC_HASHSIZE)
+
+// give p a pid and put it in the table; returns the pid, or 0 if
+// they're all in use
+static pid_t insertProc(struct proc* p) {
+	unsigned pid;
+
+	if (bitmap_alloc_from(pid_map, pid_next, &pid)) {
+		return 0;
 	}
-	// since index is unique, return from the MIN
-	return i + PID_MIN;
+	KASSERT(pid >= PID_MIN && pid <= PID_MAX);
+	pid_next = (pid == PID_MAX) ? PID_MIN : (pid_t)pid + 1;
+
+	p->p_id = pid;
+	p->p_hashnext = p_hash[PROC_HASH(pid)];
+	p_hash[PROC_HASH(pid)] = p;
+	return pid;
 }
 
-// remove a process from procs before it gets destroyed
-// it only NULLifies it
-static void removeProc(struct array* procs, struct proc* p) {
-	KASSERT(procs != NULL);
+// remove a process from the table before it gets destroyed, and
+// free its pid
+static void removeProc(struct proc* p) {
+	struct proc** pp;
+
 	KASSERT(p != NULL);
-	// get index
-	unsigned int i = p->p_id - PID_MIN;
-	// NULLify only
-	array_set(procs, i, NULL);
+	if (p->p_id == 0) {
+		// never got a pid
+		return;
+	}
+	for (pp = &p_hash[PROC_HASH(p->p_id)]; *pp != p;
+	     pp = &(*pp)->p_hashnext) {
+		KASSERT(*pp != NULL);
+	}
+	*pp = p->p_hashnext;
+	bitmap_unmark(pid_map, p->p_id);
 }
 
 // return proc corresponding to pid
 // used in wait returns NULL if not found
-struct proc* getProc(struct array* procs, pid_t pid) {
-	KASSERT(procs != NULL);
-	struct proc* ret = NULL;
-
-	for (unsigned int i = 0; i < array_num(procs); i++) {
-		struct proc* now = (struct proc*)array_get(procs, i);
-		if (now != NULL && now->p_id == pid) {
-			ret = now;
-			break;
+struct proc* getProc(pid_t pid) {
+	struct proc* now;
+
+	if (pid < PID_MIN || pid > PID_MAX) {
+		return NULL;
+	}
+	for (now = p_hash[PROC_HASH(pid)]; now != NULL; now = now->p_hashnext) {
+		if (now->p_id == pid) {
+			return now;
+		}
+	}
+	return NULL;
+}
+
+// return the lowest-numbered proc with a pid of at least pid, or
+// NULL if there isn't one
+struct proc* nextProc(pid_t pid) {
+	struct proc* p;
+
+	if (pid < PID_MIN) {
+		pid = PID_MIN;
+	}
+	for (; pid <= PID_MAX; pid++) {
+		if (bitmap_isset(pid_map, pid)) {
+			p = getProc(pid);
+			if (p != NULL) {
+				return p;
+			}
 		}
 	}
-	return ret;
+	return NULL;
 }
 
 #endif // OPT_A2
@@ -161,8 +197,12 @@ proc_create(const char *name)
 	/* VFS fields */
 	proc->p_cwd = NULL;
 
+	/* CPU accounting */
+	bzero(&proc->p_usage, sizeof(proc->p_usage));
+	bzero(&proc->p_cusage, sizeof(proc->p_cusage));
+
 #ifdef UW
-	proc->console = NULL;
+	proc->p_filetable = NULL;
 #endif // UW
 
 	return proc;
@@ -220,8 +260,9 @@ proc_destroy(struct proc *proc)
 #endif // UW
 
 #ifdef UW
-	if (proc->console) {
-	  vfs_close(proc->console);
+	/* normally closed in sys_exit, but not if we never got that far */
+	if (proc->p_filetable) {
+	  filetable_destroy(proc->p_filetable);
 	}
 #endif // UW
 
@@ -229,12 +270,22 @@ proc_destroy(struct proc *proc)
 	spinlock_cleanup(&proc->p_lock);
 
 #if OPT_A2
+	// records of threads nobody joined
+	while (array_num(proc->p_uthreads) > 0) {
+		kfree(array_get(proc->p_uthreads, 0));
+		array_remove(proc->p_uthreads, 0);
+	}
+	array_destroy(proc->p_uthreads);
 	KASSERT(proc->p_cv != NULL);
 	cv_destroy(proc->p_cv);
 	lock_destroy(proc->p_cv_lock);
-	lock_acquire(p_table_lock);
-	removeProc(p_table, proc);
-	lock_release(p_table_lock);
+	KASSERT(proc->p_kids == NULL);
+	KASSERT(proc->p_zombies == NULL);
+	cv_destroy(proc->p_waitcv);
+	lock_destroy(proc->p_waitlock);
+	rwlock_acquire_write(p_table_lock);
+	removeProc(proc);
+	rwlock_release_write(p_table_lock);
 #endif
 
 	kfree(proc->p_name);
@@ -258,6 +309,35 @@ proc_destroy(struct proc *proc)
 
 }
 
+#if OPT_A2
+/*
+ * Reference counting. See the comments in proc.h for who holds
+ * references.
+ */
+void
+proc_ref(struct proc *proc)
+{
+	spinlock_acquire(&proc->p_lock);
+	proc->p_refcount++;
+	spinlock_release(&proc->p_lock);
+}
+
+void
+proc_unref(struct proc *proc)
+{
+	unsigned count;
+
+	spinlock_acquire(&proc->p_lock);
+	KASSERT(proc->p_refcount > 0);
+	count = --proc->p_refcount;
+	spinlock_release(&proc->p_lock);
+
+	if (count == 0) {
+		proc_destroy(proc);
+	}
+}
+#endif
+
 /*
  * Create the process structure for the kernel.
  */
@@ -265,18 +345,19 @@ void
 proc_bootstrap(void)
 {
 #if OPT_A2
-		p_table_lock = lock_create("Master Process Lock");
+		p_table_lock = rwlock_create("Master Process Lock");
 		if (p_table_lock == NULL) {
 			panic("could not create p_table_lock!!");
 		}
-		p_table = array_create();
-		if (p_table == NULL) {
-			panic("could not create p_table!!");
+		pid_map = bitmap_create(PID_MAX + 1);
+		if (pid_map == NULL) {
+			panic("could not create pid_map!!");
 		}
-		p_children_lock = lock_create("Children Process Lock");
-		if (p_children_lock == NULL) {
-			panic("could not create p_children_lock!!");
+		// pids below PID_MIN are never handed out
+		for (pid_t pid = 0; pid < PID_MIN; pid++) {
+			bitmap_mark(pid_map, pid);
 		}
+		pid_next = PID_MIN;
 #endif
 
   kproc = proc_create("[kernel]");
@@ -285,7 +366,7 @@ proc_bootstrap(void)
   }
 #ifdef UW
   proc_count = 0;
-  proc_count_mutex = sem_create("proc_count_mutex",1);
+  proc_count_mutex = sem_create_fifo("proc_count_mutex",1);
   if (proc_count_mutex == NULL) {
     panic("could not create proc_count_mutex semaphore\n");
   }
@@ -298,38 +379,67 @@ proc_bootstrap(void)
 #if OPT_A2
 	// kernel p_id (unique)
 	kproc->p_id = 0;
+	// kernel threads are in group 0, which is never a gang
+	kproc->p_pgid = 0;
 #endif
 }
 
+#ifdef UW
+/*
+ * Give a process started from the menu the console on stdin, stdout,
+ * and stderr, all sharing one open file.
+ */
+static
+int
+proc_openconsole(struct proc *proc)
+{
+	struct openfile *of;
+	char path[5];
+	int fd, i, result;
+
+	proc->p_filetable = filetable_create();
+	if (proc->p_filetable == NULL) {
+		return ENOMEM;
+	}
+
+	/* vfs_open may scribble on the path */
+	strcpy(path, "con:");
+	result = openfile_open(path, O_RDWR, 0, &of);
+	if (result) {
+		return result;
+	}
+	for (i=0; i<3; i++) {
+		if (i > 0) {
+			openfile_incref(of);
+		}
+		result = filetable_place(proc->p_filetable, of, &fd);
+		KASSERT(result == 0 && fd == i);
+	}
+	return 0;
+}
+#endif // UW
+
 /*
  * Create a fresh proc for use by runprogram.
  *
  * It will have no address space and will inherit the current
- * process's (that is, the kernel menu's) current directory.
+ * process's (that is, the kernel menu's) current directory. It
+ * shares the current process's open files, or if that's the menu,
+ * gets the console on descriptors 0-2.
  */
 struct proc *
 proc_create_runprogram(const char *name)
 {
 	struct proc *proc;
-	char *console_path;
+#ifdef UW
+	int result;
+#endif
 
 	proc = proc_create(name);
 	if (proc == NULL) {
 		return NULL;
 	}
 
-#ifdef UW
-	/* open the console - this should always succeed */
-	console_path = kstrdup("con:");
-	if (console_path == NULL) {
-	  panic("unable to copy console path name during process creation\n");
-	}
-	if (vfs_open(console_path,O_WRONLY,0,&(proc->console))) {
-	  panic("unable to open the console during process creation\n");
-	}
-	kfree(console_path);
-#endif // UW
-
 	/* VM fields */
 
 	proc->p_addrspace = NULL;
@@ -365,11 +475,18 @@ proc_create_runprogram(const char *name)
 #ifdef OPT_A2
 	// parent is to be set in handler later
 	proc->p_pid = 1;
+	proc->p_parent = NULL;
 	// init children
-	proc->p_children = array_create();
-	if (proc->p_children == NULL) {
-		panic("could not create children array");
+	proc->p_kids = NULL;
+	proc->p_zombies = NULL;
+	proc->p_sibling = NULL;
+	proc->p_waitlock = lock_create(name);
+	proc->p_waitcv = cv_create(name);
+	if (proc->p_waitlock == NULL || proc->p_waitcv == NULL) {
+		panic("could not create wait lock");
 	}
+	// the reaper's reference
+	proc->p_refcount = 1;
 	// init CV
 	proc->p_cv = cv_create(name);
 	// init cv lock
@@ -378,12 +495,43 @@ proc_create_runprogram(const char *name)
 	proc->p_state = ALIVE;
 	// just random value for exit_Status
 	proc->exit_status = 0;
+	proc->p_exiting = false;
+	// just the initial thread to begin with
+	proc->p_nuthreads = 1;
+	proc->p_nexttid = 1;
+	proc->p_uthreads = array_create();
+	if (proc->p_uthreads == NULL) {
+		panic("could not create user thread array");
+	}
+	proc->p_aioreqs = NULL;
 	// insert into process table and get unique pid returned
-	lock_acquire(p_table_lock);
-	proc->p_id = insertProc(p_table, proc);
-	lock_release(p_table_lock);
+	proc->p_id = 0;
+	rwlock_acquire_write(p_table_lock);
+	insertProc(proc);
+	rwlock_release_write(p_table_lock);
+	if (proc->p_id == 0) {
+		// out of pids
+		proc_destroy(proc);
+		return NULL;
+	}
+	// a new group of its own; fork puts the child in the parent's
+	proc->p_pgid = proc->p_id;
 #endif
 
+#ifdef UW
+	if (curproc->p_filetable != NULL) {
+		result = filetable_copy(curproc->p_filetable,
+					&proc->p_filetable);
+	}
+	else {
+		result = proc_openconsole(proc);
+	}
+	if (result) {
+		proc_destroy(proc);
+		return NULL;
+	}
+#endif // UW
+
 	return proc;
 }
 
@@ -427,6 +575,8 @@ proc_remthread(struct thread *t)
 	for (i=0; i<num; i++) {
 		if (threadarray_get(&proc->p_threads, i) == t) {
 			threadarray_remove(&proc->p_threads, i);
+			/* Whatever the thread does after this is lost */
+			cpuusage_add(&proc->p_usage, &t->t_usage);
 			spinlock_release(&proc->p_lock);
 			t->t_proc = NULL;
 			return;
@@ -437,6 +587,25 @@ proc_remthread(struct thread *t)
 	panic("Thread (%p) has escaped from its process (%p)\n", t, proc);
 }
 
+/*
+ * Add up the CPU usage of a process: the threads that have already
+ * left, plus the ones still in it. The latter may be running on other
+ * cpus while we look, so their counts are only a snapshot.
+ */
+void
+proc_getusage(struct proc *proc, struct cpuusage *cu)
+{
+	unsigned i, num;
+
+	spinlock_acquire(&proc->p_lock);
+	*cu = proc->p_usage;
+	num = threadarray_num(&proc->p_threads);
+	for (i=0; i<num; i++) {
+		cpuusage_add(cu, &threadarray_get(&proc->p_threads, i)->t_usage);
+	}
+	spinlock_release(&proc->p_lock);
+}
+
 /*
  * Fetch the address space of the current process. Caution: it isn't
  * refcounted. If you implement multithreaded processes, make sure to
@@ -39,12 +39,16 @@
 #include <proc.h>
 #include <synch.h>
 #include <vfs.h>
+#include <vm.h>
 #include <sfs.h>
 #include <syscall.h>
 #include <test.h>
+#include <schedtrace.h>
 #include "opt-synchprobs.h"
 #include "opt-sfs.h"
 #include "opt-net.h"
+#include "opt-spinstats.h"
+#include "opt-lockstats.h"
 
 /*
  * In-kernel menu and command dispatcher.
@@ -416,6 +420,171 @@ cmd_kheapstats(int nargs, char **args)
 	return 0;
 }
 
+#if OPT_SPINSTATS
+/*
+ * Command for printing spinlock contention statistics. The histogram
+ * columns are contended acquisitions by log2 of backoff iterations.
+ */
+static
+int
+cmd_spinstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	spinlock_stats_printall();
+
+	return 0;
+}
+#endif
+
+#if OPT_LOCKSTATS
+/*
+ * Command for printing (or, with "reset", clearing) the per-name
+ * lock and CV contention statistics.
+ */
+static
+int
+cmd_lockstats(int nargs, char **args)
+{
+	if (nargs == 2 && !strcmp(args[1], "reset")) {
+		lockstat_reset();
+		return 0;
+	}
+	if (nargs != 1) {
+		kprintf("Usage: lks [reset]\n");
+		return EINVAL;
+	}
+
+	lockstat_print();
+
+	return 0;
+}
+#endif
+
+/*
+ * Command for turning gang scheduling (co-scheduling the processes
+ * of each process group across CPUs) on and off.
+ */
+static
+int
+cmd_gang(int nargs, char **args)
+{
+	if (nargs == 2 && !strcmp(args[1], "on")) {
+		thread_setgangsched(true);
+	}
+	else if (nargs == 2 && !strcmp(args[1], "off")) {
+		thread_setgangsched(false);
+	}
+	else {
+		kprintf("Usage: gang on | off\n");
+		return EINVAL;
+	}
+	return 0;
+}
+
+/*
+ * Command for setting the load at or below which threads are packed
+ * onto as few cpus as possible (0 turns packing off), or with no
+ * argument, printing it.
+ */
+static
+int
+cmd_pack(int nargs, char **args)
+{
+	int load;
+
+	if (nargs == 1) {
+		kprintf("pack threshold: %u\n", thread_getpackthreshold());
+		return 0;
+	}
+	load = nargs == 2 ? atoi(args[1]) : -1;
+	if (load < 0) {
+		kprintf("Usage: pack [load]\n");
+		return EINVAL;
+	}
+	thread_setpackthreshold(load);
+	return 0;
+}
+
+/*
+ * Command for printing (or, with "reset", clearing) per-cpu idle
+ * residency.
+ */
+static
+int
+cmd_idlestats(int nargs, char **args)
+{
+	if (nargs == 2 && !strcmp(args[1], "reset")) {
+		thread_resetidlestats();
+		return 0;
+	}
+	if (nargs != 1) {
+		kprintf("Usage: is [reset]\n");
+		return EINVAL;
+	}
+
+	thread_printidlestats();
+
+	return 0;
+}
+
+/*
+ * Command for printing (or, with "reset", clearing) system call
+ * counts, error counts, and latency histograms.
+ */
+static
+int
+cmd_syscallstats(int nargs, char **args)
+{
+	if (nargs == 2 && !strcmp(args[1], "reset")) {
+		syscallstats_reset();
+		return 0;
+	}
+	if (nargs != 1) {
+		kprintf("Usage: sc [reset]\n");
+		return EINVAL;
+	}
+
+	syscallstats_print();
+
+	return 0;
+}
+
+#if OPT_SCHEDTRACE
+/*
+ * Command for scheduler tracing: start or stop logging, or write the
+ * trace rings to a file (which stops logging) for the host-side
+ * schedtrace decoder. Writing to emu0: puts the file on the host.
+ */
+static
+int
+cmd_schedtrace(int nargs, char **args)
+{
+	int result;
+
+	if (nargs == 2 && !strcmp(args[1], "on")) {
+		result = schedtrace_start();
+	}
+	else if (nargs == 2 && !strcmp(args[1], "off")) {
+		schedtrace_stop();
+		result = 0;
+	}
+	else if (nargs == 3 && !strcmp(args[1], "dump")) {
+		result = schedtrace_dump(args[2]);
+	}
+	else {
+		kprintf("Usage: st on | off | dump file\n");
+		return EINVAL;
+	}
+
+	if (result) {
+		kprintf("st: %s\n", strerror(result));
+	}
+	return result;
+}
+#endif
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -480,12 +649,17 @@ static const char *testmenu[] = {
 	"[tt1] Thread test 1                 ",
 	"[tt2] Thread test 2                 ",
 	"[tt3] Thread test 3                 ",
+	"[tt4] Thread fork benchmark         ",
+	"[tt5] Gang scheduling test          ",
 #if OPT_NET
 	"[net] Network test                  ",
 #endif
-	"[sy1] Semaphore test                ",
+	"[sy1] Semaphore test [fifo]         ",
 	"[sy2] Lock test             (1)     ",
-	"[sy3] CV test               (1)     ",
+	"[sy3] CV test [morph]       (1)     ",
+	"[sy4] Lock throughput test  (1)     ",
+	"[rw1] Reader-writer lock test       ",
+	"[pi1] Priority inheritance test     ",
 #ifdef UW
 	"[uw1] UW lock test          (1)     ",
 	"[uw2] UW vmstats test       (3)     ",
@@ -526,6 +700,19 @@ static const char *mainmenu[] = {
 #endif /* UW */
 #endif
 	"[kh] Kernel heap stats              ",
+#if OPT_SPINSTATS
+	"[ss] Spinlock contention stats      ",
+#endif
+#if OPT_LOCKSTATS
+	"[lks] Lock contention stats         ",
+#endif
+#if OPT_SCHEDTRACE
+	"[st] Scheduler trace on/off/dump    ",
+#endif
+	"[gang] Gang scheduling on/off       ",
+	"[pack] Consolidation threshold      ",
+	"[is] Idle residency stats           ",
+	"[sc] Syscall stats                  ",
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -583,6 +770,21 @@ static struct {
 
 	/* stats */
 	{ "kh",         cmd_kheapstats },
+#if OPT_SPINSTATS
+	{ "ss",         cmd_spinstats },
+#endif
+#if OPT_LOCKSTATS
+	{ "lks",        cmd_lockstats },
+#endif
+#if OPT_SCHEDTRACE
+	{ "st",         cmd_schedtrace },
+#endif
+
+	/* scheduler */
+	{ "gang",       cmd_gang },
+	{ "pack",       cmd_pack },
+	{ "is",         cmd_idlestats },
+	{ "sc",         cmd_syscallstats },
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -595,11 +797,16 @@ static struct {
 	{ "tt1",	threadtest },
 	{ "tt2",	threadtest2 },
 	{ "tt3",	threadtest3 },
+	{ "tt4",	threadforkbench },
+	{ "tt5",	gangtest },
 	{ "sy1",	semtest },
 
 	/* synchronization assignment tests */
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
+	{ "sy4",	locktputtest },
+	{ "rw1",	rwtest },
+	{ "pi1",	pitest },
 #ifdef UW
 	{ "uw1",	uwlocktest1 },
 	{ "uw2",	uwvmstatstest },
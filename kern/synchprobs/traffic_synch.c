@@ -115,6 +115,13 @@ intersection_sync_init(void)
     panic("could not create traffic light cv");
   }
 
+  // the lights are only ever used with intersectionLk, so broadcasts
+  // can queue the waiters straight onto it instead of waking them all
+  cv_setwaitmorph(trafficLights[north], true);
+  cv_setwaitmorph(trafficLights[east], true);
+  cv_setwaitmorph(trafficLights[south], true);
+  cv_setwaitmorph(trafficLights[west], true);
+
   vehicles = array_create();
   if (vehicles == NULL) {
     panic("could not create vehicles");
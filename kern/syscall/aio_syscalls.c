@@ -0,0 +1,403 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <lib.h>
+#include <uio.h>
+#include <synch.h>
+#include <thread.h>
+#include <current.h>
+#include <proc.h>
+#include <vnode.h>
+#include <vm.h>
+#include <copyinout.h>
+#include <filetable.h>
+#include <syscall.h>
+#include "opt-A2.h"
+
+/*
+ * Asynchronous I/O: aio_read and aio_write queue a transfer at an
+ * explicit file position and return a request id straight away;
+ * aio_wait(id) sleeps until that request is finished and returns
+ * what pread or pwrite would have.
+ *
+ * The transfers are done by a small pool of kernel threads. Those
+ * threads have no user address space, so each request carries its own
+ * kernel buffer: aio_write copies the data in when it is queued (the
+ * process may reuse its buffer at once) and aio_read's data is copied
+ * out by aio_wait, which runs in the process. The buffer bounds a
+ * single request to AIO_MAXLEN bytes; a longer one is done short, the
+ * way a pipe would, and the count says so.
+ *
+ * Requests are recycled through a free list rather than freed, since
+ * each buffer is a whole page. Each process keeps its outstanding
+ * requests on p_aioreqs; at exit or exec any that haven't been waited
+ * for are waited for and thrown away.
+ *
+ * One sleep lock covers the work queue, the free list, and every
+ * process's request list. It is never held across the I/O itself,
+ * nor across closing a request's file when it is finished with.
+ */
+
+#if OPT_A2
+
+#define AIO_WORKERS	4		/* I/O threads */
+#define AIO_MAXLEN	PAGE_SIZE	/* largest single transfer */
+#define AIO_MAXREQS	32		/* requests in existence */
+#define AIO_PROCREQS	16		/* outstanding per process */
+
+struct aioreq {
+	struct aioreq *ar_next;		/* work queue, or free list */
+	struct aioreq *ar_procnext;	/* owner's p_aioreqs */
+	int ar_id;
+	enum uio_rw ar_rw;
+	struct openfile *ar_file;	/* holds a reference */
+	off_t ar_pos;
+	size_t ar_len;
+	userptr_t ar_ubuf;		/* aio_read: where the data goes */
+	bool ar_done;
+	int ar_err;			/* once done: error, or ... */
+	size_t ar_count;		/* ... bytes transferred */
+	char *ar_data;			/* AIO_MAXLEN bytes */
+};
+
+static struct lock *aio_lock;
+static struct cv *aio_workcv;		/* workers wait for requests */
+static struct cv *aio_donecv;		/* aio_wait waits for workers */
+static struct aioreq *aio_head, *aio_tail;	/* work queue, FIFO */
+static struct aioreq *aio_free;
+static unsigned aio_nreqs;
+static int aio_nextid = 1;
+
+/*
+ * Worker thread: take requests off the queue, do them, and post the
+ * results.
+ */
+static
+void
+aio_worker(void *unused1, unsigned long unused2)
+{
+	struct aioreq *ar;
+	struct iovec iov;
+	struct uio u;
+	int result;
+
+	(void)unused1;
+	(void)unused2;
+
+	while (1) {
+		lock_acquire(aio_lock);
+		while (aio_head == NULL) {
+			cv_wait(aio_workcv, aio_lock);
+		}
+		ar = aio_head;
+		aio_head = ar->ar_next;
+		if (aio_head == NULL) {
+			aio_tail = NULL;
+		}
+		lock_release(aio_lock);
+
+		uio_kinit(&iov, &u, ar->ar_data, ar->ar_len, ar->ar_pos,
+			  ar->ar_rw);
+		if (ar->ar_rw == UIO_READ) {
+			result = VOP_READ(ar->ar_file->of_vnode, &u);
+		}
+		else {
+			result = VOP_WRITE(ar->ar_file->of_vnode, &u);
+		}
+
+		lock_acquire(aio_lock);
+		ar->ar_err = result;
+		ar->ar_count = ar->ar_len - u.uio_resid;
+		ar->ar_done = true;
+		cv_broadcast(aio_donecv, aio_lock);
+		lock_release(aio_lock);
+	}
+}
+
+/*
+ * Set up the lock and start the workers. Called once during boot.
+ */
+void
+aio_bootstrap(void)
+{
+	unsigned i;
+	int result;
+
+	aio_lock = lock_create("aio");
+	aio_workcv = cv_create("aiowork");
+	aio_donecv = cv_create("aiodone");
+	if (aio_lock == NULL || aio_workcv == NULL || aio_donecv == NULL) {
+		panic("aio_bootstrap: out of memory\n");
+	}
+
+	for (i=0; i<AIO_WORKERS; i++) {
+		result = thread_fork("aio", kproc, aio_worker, NULL, i);
+		if (result) {
+			panic("aio_bootstrap: thread_fork: %s\n",
+			      strerror(result));
+		}
+	}
+}
+
+/*
+ * Get a request structure, or NULL if there are too many already.
+ * Call with aio_lock held.
+ */
+static
+struct aioreq *
+aioreq_get(void)
+{
+	struct aioreq *ar;
+
+	KASSERT(lock_do_i_hold(aio_lock));
+
+	ar = aio_free;
+	if (ar != NULL) {
+		aio_free = ar->ar_next;
+		return ar;
+	}
+	if (aio_nreqs >= AIO_MAXREQS) {
+		return NULL;
+	}
+	ar = kmalloc(sizeof(*ar));
+	if (ar == NULL) {
+		return NULL;
+	}
+	ar->ar_data = kmalloc(AIO_MAXLEN);
+	if (ar->ar_data == NULL) {
+		kfree(ar);
+		return NULL;
+	}
+	aio_nreqs++;
+	return ar;
+}
+
+/*
+ * Finish with a request that is off every list: put it on the free
+ * list and drop its file. The last reference to a file closes it,
+ * which can mean disk I/O, so that happens after aio_lock is let go.
+ */
+static
+void
+aioreq_put(struct aioreq *ar)
+{
+	struct openfile *of;
+
+	KASSERT(!lock_do_i_hold(aio_lock));
+	KASSERT(ar->ar_done);
+
+	of = ar->ar_file;
+	ar->ar_file = NULL;
+
+	lock_acquire(aio_lock);
+	ar->ar_next = aio_free;
+	aio_free = ar;
+	lock_release(aio_lock);
+
+	openfile_decref(of);
+}
+
+/*
+ * Queue a transfer of up to LEN bytes between the file FDESC, at POS,
+ * and the user buffer UBUF. Returns the request id.
+ */
+static
+int
+aio_submit(int fdesc, userptr_t ubuf, size_t len, off_t pos,
+	   enum uio_rw rw, int *retval)
+{
+	struct openfile *of;
+	struct aioreq *ar;
+	unsigned n;
+	int result;
+
+	KASSERT(curproc->p_filetable != NULL);
+
+	result = filetable_get(curproc->p_filetable, fdesc, &of);
+	if (result) {
+		return result;
+	}
+	if (of->of_accmode == (rw == UIO_READ ? O_WRONLY : O_RDONLY)) {
+		openfile_decref(of);
+		return EBADF;
+	}
+	if (!of->of_seekable) {
+		openfile_decref(of);
+		return ESPIPE;
+	}
+	if (pos < 0) {
+		openfile_decref(of);
+		return EINVAL;
+	}
+	if (len > AIO_MAXLEN) {
+		len = AIO_MAXLEN;
+	}
+
+	lock_acquire(aio_lock);
+	n = 0;
+	for (ar = curproc->p_aioreqs; ar != NULL; ar = ar->ar_procnext) {
+		n++;
+	}
+	ar = n < AIO_PROCREQS ? aioreq_get() : NULL;
+	lock_release(aio_lock);
+	if (ar == NULL) {
+		openfile_decref(of);
+		return EAGAIN;
+	}
+
+	ar->ar_rw = rw;
+	ar->ar_file = of;
+	ar->ar_pos = pos;
+	ar->ar_len = len;
+	ar->ar_ubuf = ubuf;
+	ar->ar_done = false;
+	ar->ar_err = 0;
+	ar->ar_count = 0;
+
+	result = 0;
+	if (rw == UIO_WRITE) {
+		result = copyin((const_userptr_t)ubuf, ar->ar_data, len);
+	}
+
+	if (result) {
+		ar->ar_done = true;
+		aioreq_put(ar);
+		return result;
+	}
+
+	lock_acquire(aio_lock);
+	ar->ar_id = aio_nextid;
+	aio_nextid = aio_nextid == 0x7fffffff ? 1 : aio_nextid + 1;
+	ar->ar_procnext = curproc->p_aioreqs;
+	curproc->p_aioreqs = ar;
+
+	ar->ar_next = NULL;
+	if (aio_tail == NULL) {
+		aio_head = ar;
+	}
+	else {
+		aio_tail->ar_next = ar;
+	}
+	aio_tail = ar;
+	cv_signal(aio_workcv, aio_lock);
+	lock_release(aio_lock);
+
+	*retval = ar->ar_id;
+	return 0;
+}
+
+int
+sys_aio_read(int fdesc, userptr_t ubuf, size_t len, off_t pos, int *retval)
+{
+	return aio_submit(fdesc, ubuf, len, pos, UIO_READ, retval);
+}
+
+int
+sys_aio_write(int fdesc, userptr_t ubuf, size_t len, off_t pos, int *retval)
+{
+	return aio_submit(fdesc, ubuf, len, pos, UIO_WRITE, retval);
+}
+
+/*
+ * Wait for request ID to finish, and collect its result: for a read,
+ * copy the data out to the buffer it was given.
+ */
+int
+sys_aio_wait(int id, int *retval)
+{
+	struct aioreq *ar, **arp;
+	int result;
+
+	/*
+	 * Look the id up again after every sleep: another thread in
+	 * the process may have collected it (or exec thrown it away)
+	 * meanwhile. Take it off the list before letting go of the
+	 * lock, so nobody else can.
+	 */
+	lock_acquire(aio_lock);
+	while (1) {
+		for (arp = &curproc->p_aioreqs; *arp != NULL;
+		     arp = &(*arp)->ar_procnext) {
+			if ((*arp)->ar_id == id) {
+				break;
+			}
+		}
+		ar = *arp;
+		if (ar == NULL) {
+			lock_release(aio_lock);
+			return EINVAL;
+		}
+		if (ar->ar_done) {
+			break;
+		}
+		cv_wait(aio_donecv, aio_lock);
+	}
+	*arp = ar->ar_procnext;
+	lock_release(aio_lock);
+
+	result = ar->ar_err;
+	if (!result && ar->ar_rw == UIO_READ && ar->ar_count > 0) {
+		result = copyout(ar->ar_data, ar->ar_ubuf, ar->ar_count);
+	}
+	if (!result) {
+		*retval = ar->ar_count;
+	}
+
+	aioreq_put(ar);
+	return result;
+}
+
+/*
+ * Wait for all of process P's outstanding requests and throw them
+ * away. For exit and exec, when there is nobody left to collect them
+ * (or, for reads, anywhere left to put the data).
+ */
+void
+aio_discard(struct proc *p)
+{
+	struct aioreq *ar;
+
+	lock_acquire(aio_lock);
+	while ((ar = p->p_aioreqs) != NULL) {
+		if (!ar->ar_done) {
+			cv_wait(aio_donecv, aio_lock);
+			continue;
+		}
+		p->p_aioreqs = ar->ar_procnext;
+		lock_release(aio_lock);
+		aioreq_put(ar);
+		lock_acquire(aio_lock);
+	}
+	lock_release(aio_lock);
+}
+
+#endif /* OPT_A2 */
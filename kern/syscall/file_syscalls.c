@@ -1,60 +1,548 @@
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/seek.h>
 #include <kern/unistd.h>
+#include <limits.h>
 #include <lib.h>
 #include <uio.h>
+#include <stat.h>
+#include <synch.h>
 #include <syscall.h>
 #include <vnode.h>
 #include <vfs.h>
 #include <current.h>
 #include <proc.h>
+#include <copyinout.h>
+#include <filetable.h>
+#include "opt-A2.h"
 
-/* handler for write() system call                  */
 /*
- * n.b.
- * This implementation handles only writes to standard output 
- * and standard error, both of which go to the console.
- * Also, it does not provide any synchronization, so writes
- * are not atomic.
- *
- * You will need to improve this implementation
+ * The guts of read, write, and their vectored and positional cousins:
+ * move data between the user buffers U describes and the file. With
+ * POS NULL the transfer is at the file's seek position, which is then
+ * advanced; otherwise it's at *POS and the seek position is neither
+ * used nor touched, so positional I/O doesn't contend for it.
  */
-
-int
-sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval)
+static int
+file_io(int fdesc, struct uio *u, const off_t *pos, int *retval)
 {
-  struct iovec iov;
-  struct uio u;
+  struct openfile *of;
+  struct stat st;
+  size_t nbytes = u->uio_resid;
+  bool useoffset;
   int res;
 
-  DEBUG(DB_SYSCALL,"Syscall: write(%d,%x,%d)\n",fdesc,(unsigned int)ubuf,nbytes);
-  
-  /* only stdout and stderr writes are currently implemented */
-  if (!((fdesc==STDOUT_FILENO)||(fdesc==STDERR_FILENO))) {
-    return EUNIMP;
-  }
   KASSERT(curproc != NULL);
-  KASSERT(curproc->console != NULL);
+  KASSERT(curproc->p_filetable != NULL);
   KASSERT(curproc->p_addrspace != NULL);
 
+  res = filetable_get(curproc->p_filetable, fdesc, &of);
+  if (res) {
+    return res;
+  }
+  if (of->of_accmode == (u->uio_rw == UIO_READ ? O_WRONLY : O_RDONLY)) {
+    openfile_decref(of);
+    return EBADF;
+  }
+  if (pos != NULL && !of->of_seekable) {
+    openfile_decref(of);
+    return ESPIPE;
+  }
+  if (pos != NULL && *pos < 0) {
+    openfile_decref(of);
+    return EINVAL;
+  }
+
+  useoffset = (pos == NULL && of->of_seekable);
+  if (useoffset) {
+    lock_acquire(of->of_offsetlock);
+    if (u->uio_rw == UIO_WRITE && of->of_append) {
+      res = VOP_STAT(of->of_vnode, &st);
+      if (res) {
+        goto out;
+      }
+      of->of_offset = st.st_size;
+    }
+  }
+
+  if (pos != NULL) {
+    u->uio_offset = *pos;
+  }
+  else {
+    u->uio_offset = useoffset ? of->of_offset : 0;
+  }
+  u->uio_segflg = UIO_USERSPACE;
+  u->uio_space = curproc->p_addrspace;
+
+  if (u->uio_rw == UIO_READ) {
+    res = VOP_READ(of->of_vnode, u);
+  }
+  else {
+    res = VOP_WRITE(of->of_vnode, u);
+  }
+  if (res) {
+    goto out;
+  }
+  if (useoffset) {
+    of->of_offset = u->uio_offset;
+  }
+
+  /* pass back the number of bytes actually transferred */
+  *retval = nbytes - u->uio_resid;
+  KASSERT(*retval >= 0);
+
+ out:
+  if (useoffset) {
+    lock_release(of->of_offsetlock);
+  }
+  openfile_decref(of);
+  return res;
+}
+
+/* read and write on a single buffer */
+static int
+file_rw(int fdesc, userptr_t ubuf, size_t nbytes, enum uio_rw rw,
+        const off_t *pos, int *retval)
+{
+  struct iovec iov;
+  struct uio u;
+
   /* set up a uio structure to refer to the user program's buffer (ubuf) */
   iov.iov_ubase = ubuf;
   iov.iov_len = nbytes;
   u.uio_iov = &iov;
   u.uio_iovcnt = 1;
-  u.uio_offset = 0;  /* not needed for the console */
   u.uio_resid = nbytes;
-  u.uio_segflg = UIO_USERSPACE;
-  u.uio_rw = UIO_WRITE;
-  u.uio_space = curproc->p_addrspace;
+  u.uio_rw = rw;
+
+  return file_io(fdesc, &u, pos, retval);
+}
+
+/* handler for write() system call                  */
+int
+sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval)
+{
+  DEBUG(DB_SYSCALL,"Syscall: write(%d,%x,%d)\n",fdesc,(unsigned int)ubuf,nbytes);
+
+  return file_rw(fdesc, ubuf, nbytes, UIO_WRITE, NULL, retval);
+}
+
+#if OPT_A2
+// open: returns the lowest free file descriptor
+int
+sys_open(userptr_t upath, int flags, mode_t mode, int *retval)
+{
+  const int allflags = O_ACCMODE | O_CREAT | O_EXCL | O_TRUNC | O_APPEND;
+  struct openfile *of;
+  char *path;
+  int res;
 
-  res = VOP_WRITE(curproc->console,&u);
+  if ((flags & ~allflags) != 0 || (flags & O_ACCMODE) == O_ACCMODE) {
+    return EINVAL;
+  }
+
+  path = kmalloc(PATH_MAX);
+  if (path == NULL) {
+    return ENOMEM;
+  }
+  res = copyinstr((const_userptr_t)upath, path, PATH_MAX, NULL);
   if (res) {
+    kfree(path);
     return res;
   }
+  DEBUG(DB_SYSCALL,"Syscall: open(%s,%d)\n",path,flags);
 
-  /* pass back the number of bytes actually written */
-  *retval = nbytes - u.uio_resid;
-  KASSERT(*retval >= 0);
+  res = openfile_open(path, flags, mode, &of);
+  kfree(path);
+  if (res) {
+    return res;
+  }
+  res = filetable_place(curproc->p_filetable, of, retval);
+  if (res) {
+    openfile_decref(of);
+    return res;
+  }
+  return 0;
+}
+
+int
+sys_read(int fdesc, userptr_t ubuf, size_t nbytes, int *retval)
+{
+  DEBUG(DB_SYSCALL,"Syscall: read(%d,%x,%d)\n",fdesc,(unsigned int)ubuf,nbytes);
+
+  return file_rw(fdesc, ubuf, nbytes, UIO_READ, NULL, retval);
+}
+
+int
+sys_close(int fdesc)
+{
+  struct openfile *of;
+  int res;
+
+  res = filetable_remove(curproc->p_filetable, fdesc, &of);
+  if (res) {
+    return res;
+  }
+  openfile_decref(of);
   return 0;
 }
+
+// fsync: push the file's data out to disk
+int
+sys_fsync(int fdesc)
+{
+  struct openfile *of;
+  int res;
+
+  res = filetable_get(curproc->p_filetable, fdesc, &of);
+  if (res) {
+    return res;
+  }
+  res = VOP_FSYNC(of->of_vnode);
+  openfile_decref(of);
+  return res;
+}
+
+// lseek: the new position comes back in *retval
+int
+sys_lseek(int fdesc, off_t pos, int whence, off_t *retval)
+{
+  struct openfile *of;
+  struct stat st;
+  off_t newpos;
+  int res;
+
+  res = filetable_get(curproc->p_filetable, fdesc, &of);
+  if (res) {
+    return res;
+  }
+  if (!of->of_seekable) {
+    openfile_decref(of);
+    return ESPIPE;
+  }
+
+  lock_acquire(of->of_offsetlock);
+  switch (whence) {
+    case SEEK_SET:
+      newpos = pos;
+      break;
+    case SEEK_CUR:
+      newpos = of->of_offset + pos;
+      break;
+    case SEEK_END:
+      res = VOP_STAT(of->of_vnode, &st);
+      newpos = st.st_size + pos;
+      break;
+    default:
+      res = EINVAL;
+      break;
+  }
+  if (res == 0) {
+    // rejects negative positions
+    res = VOP_TRYSEEK(of->of_vnode, newpos);
+  }
+  if (res == 0) {
+    of->of_offset = newpos;
+    *retval = newpos;
+  }
+  lock_release(of->of_offsetlock);
+
+  openfile_decref(of);
+  return res;
+}
+
+// dup2: newfd shares oldfd's open file (and seek position); whatever
+// newfd had open before is closed
+int
+sys_dup2(int oldfd, int newfd, int *retval)
+{
+  struct openfile *of, *oldof;
+  int res;
+
+  res = filetable_get(curproc->p_filetable, oldfd, &of);
+  if (res) {
+    return res;
+  }
+  if (oldfd != newfd) {
+    // the table takes over our reference
+    res = filetable_placeat(curproc->p_filetable, of, newfd, &oldof);
+    if (res) {
+      openfile_decref(of);
+      return res;
+    }
+    if (oldof != NULL) {
+      openfile_decref(oldof);
+    }
+  }
+  else {
+    openfile_decref(of);
+  }
+  *retval = newfd;
+  return 0;
+}
+
+// pread and pwrite: at offset pos, leaving the seek position alone
+int
+sys_pread(int fdesc, userptr_t ubuf, size_t nbytes, off_t pos, int *retval)
+{
+  return file_rw(fdesc, ubuf, nbytes, UIO_READ, &pos, retval);
+}
+
+int
+sys_pwrite(int fdesc, userptr_t ubuf, size_t nbytes, off_t pos, int *retval)
+{
+  return file_rw(fdesc, ubuf, nbytes, UIO_WRITE, &pos, retval);
+}
+
+// small vectors are copied in on the stack; more than this gets kmalloc'd
+#define IOV_STACK 16
+
+// readv and writev: the user's iovec array is copied in and handed to
+// a single VOP_READ/VOP_WRITE, which walks it with uiomove
+static int
+file_rwv(int fdesc, userptr_t uiov, int iovcnt, enum uio_rw rw, int *retval)
+{
+  struct iovec stackiov[IOV_STACK];
+  struct iovec *iov;
+  struct uio u;
+  size_t total = 0;
+  int res;
+
+  if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+    return EINVAL;
+  }
+  if (iovcnt <= IOV_STACK) {
+    iov = stackiov;
+  }
+  else {
+    iov = kmalloc(iovcnt * sizeof(struct iovec));
+    if (iov == NULL) {
+      return ENOMEM;
+    }
+  }
+
+  // the user's struct iovec is laid out just like ours
+  res = copyin((const_userptr_t)uiov, iov, iovcnt * sizeof(struct iovec));
+  if (res) {
+    goto out;
+  }
+  for (int i = 0; i < iovcnt; i++) {
+    // the total has to fit in the return value
+    if (iov[i].iov_len > 0x7fffffffU - total) {
+      res = EINVAL;
+      goto out;
+    }
+    total += iov[i].iov_len;
+  }
+
+  u.uio_iov = iov;
+  u.uio_iovcnt = iovcnt;
+  u.uio_resid = total;
+  u.uio_rw = rw;
+  res = file_io(fdesc, &u, NULL, retval);
+
+ out:
+  if (iov != stackiov) {
+    kfree(iov);
+  }
+  return res;
+}
+
+// copy_file_range moves data through a kernel buffer this big; the
+// largest size kmalloc serves from its subpage pools
+#define COPY_CHUNK 2048
+
+// copy_file_range: copy up to len bytes from infd to outfd without the
+// data going out to user space and back. A NULL offset pointer means
+// the file's seek position, which is advanced; otherwise the offset
+// there is used and updated and the seek position is left alone.
+int
+sys_copy_file_range(int infd, userptr_t uinoff, int outfd, userptr_t uoutoff,
+                    size_t len, unsigned flags, int *retval)
+{
+  struct filetable *ft = curproc->p_filetable;
+  struct openfile *in = NULL, *out = NULL;
+  struct lock *first = NULL, *second = NULL;
+  off_t inpos = 0, outpos = 0;
+  bool inlock, outlock;
+  struct iovec iov;
+  struct uio u;
+  struct stat st;
+  size_t done = 0, chunk, got, wrote;
+  char *buf = NULL;
+  int res;
+
+  if (flags != 0) {
+    return EINVAL;
+  }
+  // the count has to fit in the return value
+  if (len > 0x7fffffffU) {
+    len = 0x7fffffffU;
+  }
+
+  res = filetable_get(ft, infd, &in);
+  if (res) {
+    return res;
+  }
+  res = filetable_get(ft, outfd, &out);
+  if (res) {
+    goto out;
+  }
+  if (in->of_accmode == O_WRONLY || out->of_accmode == O_RDONLY) {
+    res = EBADF;
+    goto out;
+  }
+  if ((uinoff != NULL && !in->of_seekable) ||
+      (uoutoff != NULL && !out->of_seekable)) {
+    res = ESPIPE;
+    goto out;
+  }
+  if (uinoff != NULL) {
+    res = copyin((const_userptr_t)uinoff, &inpos, sizeof(off_t));
+    if (res) {
+      goto out;
+    }
+  }
+  if (uoutoff != NULL) {
+    res = copyin((const_userptr_t)uoutoff, &outpos, sizeof(off_t));
+    if (res) {
+      goto out;
+    }
+  }
+  if (inpos < 0 || outpos < 0) {
+    res = EINVAL;
+    goto out;
+  }
+
+  inlock = (uinoff == NULL && in->of_seekable);
+  outlock = (uoutoff == NULL && out->of_seekable);
+  if (inlock && outlock && in == out) {
+    // one seek position can't be in two places
+    res = EINVAL;
+    goto out;
+  }
+
+  buf = kmalloc(COPY_CHUNK);
+  if (buf == NULL) {
+    res = ENOMEM;
+    goto out;
+  }
+
+  // with two seek positions to hold, take them in address order so
+  // that copies going opposite ways can't deadlock
+  if (inlock) {
+    first = in->of_offsetlock;
+  }
+  if (outlock) {
+    second = out->of_offsetlock;
+  }
+  if (first != NULL && second != NULL && second < first) {
+    struct lock *tmp = first;
+    first = second;
+    second = tmp;
+  }
+  if (first != NULL) {
+    lock_acquire(first);
+  }
+  if (second != NULL) {
+    lock_acquire(second);
+  }
+
+  if (inlock) {
+    inpos = in->of_offset;
+  }
+  if (outlock) {
+    if (out->of_append) {
+      res = VOP_STAT(out->of_vnode, &st);
+      if (res) {
+        goto unlock;
+      }
+      out->of_offset = st.st_size;
+    }
+    outpos = out->of_offset;
+  }
+
+  while (done < len) {
+    chunk = len - done;
+    if (chunk > COPY_CHUNK) {
+      chunk = COPY_CHUNK;
+    }
+    uio_kinit(&iov, &u, buf, chunk, inpos, UIO_READ);
+    res = VOP_READ(in->of_vnode, &u);
+    if (res) {
+      break;
+    }
+    got = chunk - u.uio_resid;
+    if (got == 0) {
+      // end of file
+      break;
+    }
+    uio_kinit(&iov, &u, buf, got, outpos, UIO_WRITE);
+    res = VOP_WRITE(out->of_vnode, &u);
+    wrote = got - u.uio_resid;
+    inpos += wrote;
+    outpos += wrote;
+    done += wrote;
+    if (res || wrote < got) {
+      break;
+    }
+  }
+  // running into trouble after copying something is a short copy,
+  // like a short write
+  if (done > 0) {
+    res = 0;
+  }
+
+  if (inlock) {
+    in->of_offset = inpos;
+  }
+  if (outlock) {
+    out->of_offset = outpos;
+  }
+ unlock:
+  if (second != NULL) {
+    lock_release(second);
+  }
+  if (first != NULL) {
+    lock_release(first);
+  }
+  if (res) {
+    goto out;
+  }
+
+  if (uinoff != NULL) {
+    res = copyout(&inpos, uinoff, sizeof(off_t));
+    if (res) {
+      goto out;
+    }
+  }
+  if (uoutoff != NULL) {
+    res = copyout(&outpos, uoutoff, sizeof(off_t));
+    if (res) {
+      goto out;
+    }
+  }
+  *retval = done;
+
+ out:
+  kfree(buf);
+  if (out != NULL) {
+    openfile_decref(out);
+  }
+  openfile_decref(in);
+  return res;
+}
+
+int
+sys_readv(int fdesc, userptr_t iov, int iovcnt, int *retval)
+{
+  return file_rwv(fdesc, iov, iovcnt, UIO_READ, retval);
+}
+
+int
+sys_writev(int fdesc, userptr_t iov, int iovcnt, int *retval)
+{
+  return file_rwv(fdesc, iov, iovcnt, UIO_WRITE, retval);
+}
+#endif // OPT_A2
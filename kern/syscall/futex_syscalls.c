@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <synch.h>
+#include <wchan.h>
+#include <current.h>
+#include <proc.h>
+#include <copyinout.h>
+#include <syscall.h>
+#include "opt-A2.h"
+
+/*
+ * Futexes: sleep and wake on a word of user memory.
+ *
+ * futex_wait(addr, val) sleeps if *addr still holds val; futex_wake
+ * (addr, n) wakes up to n threads sleeping on addr. That is enough
+ * for user code to build locks that only enter the kernel when they
+ * actually have to sleep.
+ *
+ * Sleepers are kept in a fixed hash table keyed by (address space,
+ * user address), so there is no per-futex kernel state at all. Each
+ * bucket has a sleep lock (we copyin under it, which may fault), a
+ * list of waiters, and a wait channel the waiters sleep on; wakers
+ * pick out the matching waiters and wake exactly those.
+ */
+
+#define FUTEX_BUCKETS 64
+
+struct futex_waiter {
+	struct addrspace *fw_as;
+	userptr_t fw_uaddr;
+	struct thread *fw_thread;
+	struct futex_waiter *fw_next;
+};
+
+struct futex_bucket {
+	struct lock *fb_lock;
+	struct wchan *fb_wchan;
+	struct futex_waiter *fb_waiters;
+};
+
+static struct futex_bucket futex_table[FUTEX_BUCKETS];
+
+/*
+ * Set up the hash table. Called once during boot.
+ */
+void
+futex_bootstrap(void)
+{
+	unsigned i;
+
+	for (i=0; i<FUTEX_BUCKETS; i++) {
+		futex_table[i].fb_lock = lock_create("futex");
+		futex_table[i].fb_wchan = wchan_create("futex");
+		if (futex_table[i].fb_lock == NULL ||
+		    futex_table[i].fb_wchan == NULL) {
+			panic("futex_bootstrap: out of memory\n");
+		}
+		futex_table[i].fb_waiters = NULL;
+	}
+}
+
+static
+struct futex_bucket *
+futex_hash(struct addrspace *as, userptr_t uaddr)
+{
+	uintptr_t key;
+
+	key = ((uintptr_t)as >> 4) ^ ((uintptr_t)uaddr >> 2);
+	key ^= key >> 11;
+	return &futex_table[key % FUTEX_BUCKETS];
+}
+
+/*
+ * Sleep on UADDR if it contains VAL. Returns EAGAIN if it doesn't.
+ */
+int
+sys_futex_wait(userptr_t uaddr, int val)
+{
+	struct futex_bucket *fb;
+	struct futex_waiter me, **fwp;
+	int cur, result;
+
+	if ((uintptr_t)uaddr % sizeof(int) != 0) {
+		return EINVAL;
+	}
+
+	me.fw_as = curproc_getas();
+	me.fw_uaddr = uaddr;
+	me.fw_thread = curthread;
+	fb = futex_hash(me.fw_as, uaddr);
+
+	lock_acquire(fb->fb_lock);
+
+	/*
+	 * Check the value with the bucket locked, so a futex_wake
+	 * that follows a change to *uaddr can't slip in between the
+	 * check and our going to sleep.
+	 */
+	result = copyin(uaddr, &cur, sizeof(cur));
+	if (result) {
+		lock_release(fb->fb_lock);
+		return result;
+	}
+	if (cur != val) {
+		lock_release(fb->fb_lock);
+		return EAGAIN;
+	}
+#if OPT_A2
+	/*
+	 * Don't sleep if another thread is exiting the process; it
+	 * sets the flag before it empties the buckets (futex_wakeall).
+	 */
+	if (curproc->p_exiting) {
+		lock_release(fb->fb_lock);
+		return EINTR;
+	}
+#endif
+
+	/* Queue at the tail so wakeups are FIFO */
+	for (fwp = &fb->fb_waiters; *fwp != NULL; fwp = &(*fwp)->fw_next) {
+		/* nothing */
+	}
+	me.fw_next = NULL;
+	*fwp = &me;
+
+	/* Same dance as cv_wait */
+	wchan_lock(fb->fb_wchan);
+	lock_release(fb->fb_lock);
+	wchan_sleep(fb->fb_wchan);
+
+	/* futex_wake took us off the list */
+	return 0;
+}
+
+/*
+ * Wake up to COUNT threads sleeping on UADDR. Returns the number
+ * woken.
+ */
+int
+sys_futex_wake(userptr_t uaddr, int count, int *retval)
+{
+	struct futex_bucket *fb;
+	struct futex_waiter **fwp, *fw;
+	struct addrspace *as;
+	int woken;
+
+	if ((uintptr_t)uaddr % sizeof(int) != 0) {
+		return EINVAL;
+	}
+
+	as = curproc_getas();
+	fb = futex_hash(as, uaddr);
+	woken = 0;
+
+	lock_acquire(fb->fb_lock);
+	fwp = &fb->fb_waiters;
+	while (*fwp != NULL && woken < count) {
+		fw = *fwp;
+		if (fw->fw_as == as && fw->fw_uaddr == uaddr) {
+			*fwp = fw->fw_next;
+			/* fw lives on the sleeper's stack; done with it now */
+			wchan_wakethread(fb->fb_wchan, fw->fw_thread);
+			woken++;
+		}
+		else {
+			fwp = &fw->fw_next;
+		}
+	}
+	lock_release(fb->fb_lock);
+
+	*retval = woken;
+	return 0;
+}
+
+/*
+ * Wake every thread sleeping on a futex in AS. Used when a process
+ * is exiting, so its other threads get back out to the trap code and
+ * leave.
+ */
+void
+futex_wakeall(struct addrspace *as)
+{
+	struct futex_bucket *fb;
+	struct futex_waiter **fwp, *fw;
+	unsigned i;
+
+	for (i=0; i<FUTEX_BUCKETS; i++) {
+		fb = &futex_table[i];
+		lock_acquire(fb->fb_lock);
+		fwp = &fb->fb_waiters;
+		while (*fwp != NULL) {
+			fw = *fwp;
+			if (fw->fw_as == as) {
+				*fwp = fw->fw_next;
+				wchan_wakethread(fb->fb_wchan, fw->fw_thread);
+			}
+			else {
+				fwp = &fw->fw_next;
+			}
+		}
+		lock_release(fb->fb_lock);
+	}
+}
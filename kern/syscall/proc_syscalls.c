@@ -14,22 +14,63 @@
 #include <vm.h>
 #include <vfs.h>
 #include <copyinout.h>
+#include <filetable.h>
 #include <kern/wait.h>
 #include "opt-A2.h"
 
+static void exit_process(struct proc *p);
+
 
   /* this implementation of sys__exit does not do anything with the exit code */
   /* this needs to be fixed to get exit() and waitpid() working properly */
 #if OPT_A2
 
-// free arguments!
-static void kfree_args(char** argv, size_t argc) {
-  for (size_t i = 0; i < argc; i++) {
-    kfree(argv[i]);
-    argv[i] = NULL;
+// Exec arguments, packed the way they'll sit on the new stack: the
+// argv pointers, then the strings. Until we know where the block is
+// going, each pointer holds its string's offset within the block.
+// Blocks are ARG_MAX bytes and are kept for reuse instead of freed,
+// so an exec doesn't have to find 16 contiguous pages every time.
+struct argbuf {
+  struct argbuf* ab_next;   // on the free list
+  char* ab_data;            // ARG_MAX bytes
+  size_t ab_len;            // bytes used
+  size_t ab_argc;
+};
+
+static struct spinlock argbuf_lock = SPINLOCK_INITIALIZER;
+static struct argbuf* argbuf_free;
+
+static struct argbuf* argbuf_get(void) {
+  struct argbuf* ab;
+
+  spinlock_acquire(&argbuf_lock);
+  ab = argbuf_free;
+  if (ab != NULL) {
+    argbuf_free = ab->ab_next;
+  }
+  spinlock_release(&argbuf_lock);
+
+  if (ab == NULL) {
+    ab = kmalloc(sizeof(struct argbuf));
+    if (ab == NULL) {
+      return NULL;
+    }
+    ab->ab_data = kmalloc(ARG_MAX);
+    if (ab->ab_data == NULL) {
+      kfree(ab);
+      return NULL;
+    }
   }
-  kfree(argv);
-  argv = NULL;
+  ab->ab_len = 0;
+  ab->ab_argc = 0;
+  return ab;
+}
+
+static void argbuf_put(struct argbuf* ab) {
+  spinlock_acquire(&argbuf_lock);
+  ab->ab_next = argbuf_free;
+  argbuf_free = ab;
+  spinlock_release(&argbuf_lock);
 }
 
 // free as and roll-back to previous as
@@ -41,79 +82,143 @@ static void as_destroy_and_rollback(struct addrspace* cur, struct addrspace* pre
   as_destroy(cur);
 }
 
-// A02b
-int sys_execv(userptr_t progname, userptr_t args) {
-  struct addrspace *as, *old_as;
-  struct vnode *v;
-  vaddr_t entrypoint, stackptr;
+// copy a program path in from user space
+static int path_copyin(userptr_t path, char** pathp) {
+  size_t path_length;
   int result;
-  // args parameters...
-  size_t argc = 0;
-  char** argv;
 
-  // count # arguments
-  while ( ((char**)args)[argc] != NULL ) argc++;
-  // too many arguments
-  if (argc > ARG_MAX / PATH_MAX) {
-    return E2BIG;
+  char* path_kernel = (char*)kmalloc(PATH_MAX * sizeof(char));
+  if (path_kernel == NULL) {
+    return ENOMEM;
   }
+  result = copyinstr((const_userptr_t)path, path_kernel, PATH_MAX, &path_length);
+  if (result) {
+    kfree(path_kernel);
+    return result;
+  }
+  DEBUG(DB_SYSCALL, "copied program name: %s, length: %d\n", path_kernel, path_length);
+  *pathp = path_kernel;
+  return 0;
+}
 
-  // allocate mem ( +1 for NULL ended)
-  argv = (char**)kmalloc((argc + 1) * sizeof(char*));
-  if (argv == NULL) {
+// copy a NULL-terminated argument vector in from user space. On
+// success the caller owns *abp and gives it back with argbuf_put.
+static int args_copyin(userptr_t args, struct argbuf** abp) {
+  struct argbuf* ab;
+  vaddr_t uargs = (vaddr_t)args;
+  vaddr_t* slots;
+  size_t argc = 0, nslots = 0, len;
+  int result;
+
+  if (uargs % sizeof(vaddr_t) != 0) {
+    return EFAULT;
+  }
+  ab = argbuf_get();
+  if (ab == NULL) {
     return ENOMEM;
   }
+  slots = (vaddr_t*)ab->ab_data;
 
-  // copy argument strings
+  // the pointers go straight into the front of the block. If the
+  // first one is mapped the rest of its page is too, so copy a page
+  // at a time: usually that's the whole array in one copyin.
+  for (;;) {
+    if (argc == nslots) {
+      vaddr_t from = uargs + nslots * sizeof(vaddr_t);
+      size_t chunk = PAGE_SIZE - from % PAGE_SIZE;
+      if (chunk > ARG_MAX - nslots * sizeof(vaddr_t)) {
+        chunk = ARG_MAX - nslots * sizeof(vaddr_t);
+      }
+      if (chunk == 0) {
+        // too many arguments
+        argbuf_put(ab);
+        return E2BIG;
+      }
+      result = copyin((const_userptr_t)from, slots + nslots, chunk);
+      if (result) {
+        argbuf_put(ab);
+        return result;
+      }
+      nslots += chunk / sizeof(vaddr_t);
+    }
+    if (slots[argc] == 0) {
+      break;
+    }
+    argc++;
+  }
+
+  // then the strings, packed in after the NULL that ends the pointers
+  len = (argc + 1) * sizeof(vaddr_t);
   for (size_t i = 0; i < argc; i++) {
     size_t argument_length;
-    argv[i] = (char*)kmalloc(PATH_MAX * sizeof(char));
-    if (argv[i] == NULL) {
-      return ENOMEM;
+    result = copyinstr((const_userptr_t)slots[i], ab->ab_data + len,
+                       ARG_MAX - len, &argument_length);
+    if (result == ENAMETOOLONG) {
+      result = E2BIG;
     }
-
-    result = copyinstr((const_userptr_t)((char**)args)[i], argv[i], PATH_MAX, &argument_length);
     if (result) {
+      argbuf_put(ab);
       return result;
     }
+    // from here on the pointer is where the string is in the block
+    slots[i] = len;
+    len += argument_length;
   }
-  argv[argc] = NULL;
 
   #if DEBUG
     for (size_t i = 0; i < argc; i++) {
-      kprintf("Argument #%d: %s\n", i, argv[i]);
+      kprintf("Argument #%d: %s\n", i, ab->ab_data + slots[i]);
     }
   #endif
 
-  // program name parameters... unknown for now
-  size_t progname_length;
-  char* progname_kernel = (char*)kmalloc(PATH_MAX * sizeof(char));
-  if (progname_kernel == NULL) {
-    kfree_args(argv, argc);
-    return ENOMEM;
-  }
+  ab->ab_len = len;
+  ab->ab_argc = argc;
+  *abp = ab;
+  return 0;
+}
 
-  // copy progname from user to kernel
-  result = copyinstr((const_userptr_t)progname, progname_kernel, PATH_MAX, &progname_length);
+// put the argument block on the user stack below *stackp, pointing
+// the argv pointers at where the strings land, all in one copyout.
+// *stackp comes back as the address of argv.
+static int args_copyout(struct argbuf* ab, vaddr_t* stackp) {
+  vaddr_t* slots = (vaddr_t*)ab->ab_data;
+  // stack grows downward; keep it 8-byte aligned
+  vaddr_t base = (*stackp - ab->ab_len) & ~(vaddr_t)7;
+  int result;
+
+  for (size_t i = 0; i < ab->ab_argc; i++) {
+    slots[i] += base;
+  }
+  result = copyout(ab->ab_data, (userptr_t)base, ab->ab_len);
   if (result) {
-    kfree_args(argv, argc);
-    kfree(progname_kernel);
     return result;
   }
-  DEBUG(DB_SYSCALL, "copied program name: %s, length: %d\n", progname_kernel, progname_length);
+  *stackp = base;
+  return 0;
+}
+
+// Load the program at path (a kernel string) into a new address space,
+// make that the current one, and lay the arguments out on its stack.
+// On success the address space it replaced (NULL for a spawned child)
+// comes back in *old_asp for the caller to destroy; on failure the old
+// one is put back. args stays the caller's either way.
+static int load_program(char* path, struct argbuf* args,
+                        vaddr_t* entryp, vaddr_t* stackp,
+                        struct addrspace** old_asp) {
+  struct addrspace *as, *old_as;
+  struct vnode *v;
+  vaddr_t entrypoint, stackptr;
+  int result;
 
   /* Open the file. */
-  result = vfs_open(progname_kernel, O_RDONLY, 0, &v);
-  kfree(progname_kernel);   // don't need anymore.... right...?
+  result = vfs_open(path, O_RDONLY, 0, &v);
   if (result) {
-    kfree_args(argv, argc);
     return result;
   }
 
   /* Create a new address space. */
   as = as_create();
   if (as ==NULL) {
-    kfree_args(argv, argc);
   	vfs_close(v);
   	return ENOMEM;
   }
@@ -125,7 +230,6 @@ int sys_execv(userptr_t progname, userptr_t args) {
   /* Load the executable. */
   result = load_elf(v, &entrypoint);
   if (result) {
-    kfree_args(argv, argc);
     as_destroy_and_rollback(as, old_as);
   	vfs_close(v);
   	return result;
@@ -137,59 +241,61 @@ int sys_execv(userptr_t progname, userptr_t args) {
   /* Define the user stack in the address space */
   result = as_define_stack(as, &stackptr);
   if (result) {
-    kfree_args(argv, argc);
     as_destroy_and_rollback(as, old_as);
   	return result;
   }
 
-  // starting from the bottom of the stack
-  // stack up the following order:
-  // 1. strings
-  // 2. pointers to the strings (should be padded)
-  // *********************************************
-  for (size_t i = 0; i < argc; i++) {
-    // reverse order
-    size_t r = (argc - 1) - i;
-    // + 1 for NULL terminator
-    // Easier if all strings are blocks of 4
-    size_t arg_size = sizeof(char) * (strlen((const char*)argv[r]) + 1);
-
-    // stack grows downward
-    // almost like push_stack
-    // copy into stack
-    stackptr -= arg_size;
-    result = copyoutstr((const char*)argv[r], (userptr_t)stackptr, PATH_MAX, &arg_size);
-    if (result) {
-      // can conflict when there are mix of kernel & user pointers
-      kfree_args(argv, argc);
-      as_destroy_and_rollback(as, old_as);
-    	return result;
-    }
-    // free kernel strings (since they are now on user stack)
-    kfree(argv[r]);
-    // save top of stack address
-    argv[r] = (char*)stackptr;
-  }
-
-  // pointers should be padded (but 4 or 8 bytes???)
-  stackptr -= stackptr % 8;
-  // copy pointers to strings
-  for (size_t i = 0; i <= argc; i++) {
-    // reverse order (starting from NULL terminator)
-    size_t r = argc - i;
-    // push_stack
-    // copy into stack
-    stackptr -= sizeof(char*);
-    copyout(argv + r, (userptr_t)stackptr, sizeof(char*));
-    if (result) {
-      as_destroy_and_rollback(as, old_as);
-    	return result;
-    }
+  result = args_copyout(args, &stackptr);
+  if (result) {
+    as_destroy_and_rollback(as, old_as);
+    return result;
+  }
+
+  *entryp = entrypoint;
+  *stackp = stackptr;
+  *old_asp = old_as;
+  return 0;
+}
+
+// A02b
+int sys_execv(userptr_t progname, userptr_t args) {
+  struct addrspace *old_as;
+  vaddr_t entrypoint, stackptr;
+  int result;
+  // args parameters...
+  struct argbuf* ab;
+  size_t argc;
+  char* progname_kernel;
+
+  // can't swap the address space out from under other threads
+  if (curproc->p_nuthreads > 1) {
+    return EBUSY;
   }
 
-  // free args, no logner need to
-  // since they are all freed in the for-loop
-  // kfree_args(argv, argc);
+  result = args_copyin(args, &ab);
+  if (result) {
+    return result;
+  }
+
+  // copy progname from user to kernel
+  result = path_copyin(progname, &progname_kernel);
+  if (result) {
+    argbuf_put(ab);
+    return result;
+  }
+
+  result = load_program(progname_kernel, ab,
+                        &entrypoint, &stackptr, &old_as);
+  // all on the user stack now (or failed)
+  argc = ab->ab_argc;
+  kfree(progname_kernel);
+  argbuf_put(ab);
+  if (result) {
+    return result;
+  }
+
+  // reads still in flight were headed for the old image
+  aio_discard(curproc);
 
   // destory old address sapce
   as_destroy(old_as);
@@ -203,13 +309,29 @@ int sys_execv(userptr_t progname, userptr_t args) {
   return EINVAL;
 }
 
+// make child one of our children: same process group (and so the
+// same gang), and linked in where waitpid and exit can find it
+static void add_child(struct proc* child_p) {
+    // relate to parent
+    child_p->p_pid = curproc->p_id;
+    // same process group (and so the same gang)
+    child_p->p_pgid = curproc->p_pgid;
+    // relate to children; the child's pointer holds a reference on us
+    proc_ref(curproc);
+    child_p->p_parent = curproc;
+    lock_acquire(curproc->p_waitlock);
+    child_p->p_sibling = curproc->p_kids;
+    curproc->p_kids = child_p;
+    lock_release(curproc->p_waitlock);
+}
+
 int sys_fork(struct trapframe* tf, pid_t* retVal) {
     int err;
     // TODO: Should I save curproc into a var with lock???
     // create new proc
     struct proc* child_p = proc_create_runprogram(curproc->p_name);
     if (child_p == NULL) {
-      panic("Can't create a new child process!");
+      // out of pids (or memory)
       return ENPROC;
     }
 
@@ -225,12 +347,7 @@ int sys_fork(struct trapframe* tf, pid_t* retVal) {
     struct trapframe* child_tf = kmalloc(sizeof(struct trapframe));
     memcpy(child_tf, tf, sizeof(struct trapframe));
 
-    // relate to parent
-    child_p->p_pid = curproc->p_id;
-    // relate to children
-    spinlock_acquire(&curproc->p_lock);
-    array_add(curproc->p_children, child_p, NULL);
-    spinlock_release(&curproc->p_lock);
+    add_child(child_p);
 
     // attach a new thread
     err = thread_fork(child_p->p_name,
@@ -244,30 +361,269 @@ int sys_fork(struct trapframe* tf, pid_t* retVal) {
     *retVal = child_p->p_id;
     return 0;
 }
+
+// A thread is leaving: record its exit value (if it came from
+// thread_create) and wake any joiner. Returns true if it was the last
+// thread in the process, which then has to tear the process down;
+// otherwise the thread has been detached from the process and only
+// has to call thread_exit.
+static bool uthread_leave(struct proc* p, int value) {
+  struct uthread* ut = curthread->t_uthread;
+  bool last;
+
+  lock_acquire(p->p_cv_lock);
+  if (ut != NULL) {
+    ut->ut_done = true;
+    ut->ut_value = value;
+    curthread->t_uthread = NULL;
+  }
+  KASSERT(p->p_nuthreads > 0);
+  p->p_nuthreads--;
+  last = (p->p_nuthreads == 0);
+  // detach before the lock goes: once the last thread sees the count
+  // hit 0 the process can be reaped and destroyed, and it must not
+  // still have us in p_threads
+  if (!last) {
+    proc_remthread(curthread);
+  }
+  cv_broadcast(p->p_cv, p->p_cv_lock);
+  lock_release(p->p_cv_lock);
+
+  return last;
+}
+
+// Start a new thread in this process at user address entry, with func
+// and arg in a0 and a1, running on the stack whose top is stack.
+// libc's thread_create wraps this with a trampoline that calls
+// func(arg) and then thread_exit. ptf is the caller's trapframe, for
+// the registers the new thread shares with it.
+int sys___thread_create(struct trapframe* ptf, userptr_t entry,
+                        userptr_t func, userptr_t arg, userptr_t stack,
+                        int* retval) {
+  struct proc* p = curproc;
+  struct uthread* ut;
+  struct trapframe* tf;
+  int tid, err;
+
+  if (entry == NULL || stack == NULL) {
+    return EFAULT;
+  }
+
+  ut = kmalloc(sizeof(struct uthread));
+  if (ut == NULL) {
+    return ENOMEM;
+  }
+  tf = kmalloc(sizeof(struct trapframe));
+  if (tf == NULL) {
+    kfree(ut);
+    return ENOMEM;
+  }
+  ut->ut_done = false;
+  ut->ut_joining = false;
+  ut->ut_value = 0;
+
+  bzero(tf, sizeof(struct trapframe));
+  tf->tf_epc = (vaddr_t)entry;
+  tf->tf_a0 = (vaddr_t)func;
+  tf->tf_a1 = (vaddr_t)arg;
+  // user code addresses small globals (errno, for one) off gp
+  tf->tf_gp = ptf->tf_gp;
+  // leave the 16 bytes above sp the o32 ABI gives the callee for
+  // spilling a0-a3, inside the caller's buffer, and keep the stack
+  // 8-byte aligned
+  tf->tf_sp = ((vaddr_t)stack - 16) & ~(vaddr_t)7;
+
+  lock_acquire(p->p_cv_lock);
+  ut->ut_tid = p->p_nexttid++;
+  // ut is the joiner's to free once the thread is running
+  tid = ut->ut_tid;
+  err = array_add(p->p_uthreads, ut, NULL);
+  if (err) {
+    lock_release(p->p_cv_lock);
+    kfree(tf);
+    kfree(ut);
+    return err;
+  }
+  p->p_nuthreads++;
+  lock_release(p->p_cv_lock);
+
+  err = thread_fork(p->p_name, p, enter_new_thread, tf, (unsigned long)ut);
+  if (err) {
+    lock_acquire(p->p_cv_lock);
+    p->p_nuthreads--;
+    for (unsigned int i = 0; i < array_num(p->p_uthreads); i++) {
+      if (array_get(p->p_uthreads, i) == ut) {
+        array_remove(p->p_uthreads, i);
+        break;
+      }
+    }
+    lock_release(p->p_cv_lock);
+    kfree(tf);
+    kfree(ut);
+    return err;
+  }
+
+  *retval = tid;
+  return 0;
+}
+
+// Wait for thread tid to call thread_exit, and collect its value.
+int sys_thread_join(int tid, userptr_t value) {
+  struct proc* p = curproc;
+  struct uthread* ut = NULL;
+  unsigned int i;
+  int result, v;
+
+  lock_acquire(p->p_cv_lock);
+  for (i = 0; i < array_num(p->p_uthreads); i++) {
+    ut = array_get(p->p_uthreads, i);
+    if (ut->ut_tid == tid) {
+      break;
+    }
+  }
+  if (i == array_num(p->p_uthreads)) {
+    lock_release(p->p_cv_lock);
+    return ESRCH;
+  }
+  // can't join yourself, and only one thread gets to join
+  if (ut == curthread->t_uthread || ut->ut_joining) {
+    lock_release(p->p_cv_lock);
+    return EINVAL;
+  }
+  ut->ut_joining = true;
+  while (!ut->ut_done) {
+    if (p->p_exiting) {
+      // we're going too; leave ut to the teardown
+      ut->ut_joining = false;
+      lock_release(p->p_cv_lock);
+      return EINTR;
+    }
+    cv_wait(p->p_cv, p->p_cv_lock);
+  }
+  // nobody else removes it once ut_joining is set, but it may have moved
+  for (i = 0; i < array_num(p->p_uthreads); i++) {
+    if (array_get(p->p_uthreads, i) == ut) {
+      array_remove(p->p_uthreads, i);
+      break;
+    }
+  }
+  lock_release(p->p_cv_lock);
+
+  v = ut->ut_value;
+  kfree(ut);
+  if (value != NULL) {
+    result = copyout(&v, value, sizeof(int));
+    if (result) {
+      return result;
+    }
+  }
+  return 0;
+}
+
+// End the calling thread. If it's the last one the process exits, with
+// status 0 (or whatever _exit set, if another thread is exiting it).
+void sys_thread_exit(int value) {
+  struct proc* p = curproc;
+
+  if (!uthread_leave(p, value)) {
+    thread_exit();
+  }
+  exit_process(p);
+}
+
+// _exit, or death by a signal: save the wait status for the parent
+// and take every thread in the process down with us
+static void exit_with(int waitstatus) {
+  struct proc *p = curproc;
+
+  // save for parent wait; if two threads exit at once, the first wins
+  lock_acquire(p->p_cv_lock);
+  if (!p->p_exiting) {
+    p->p_exiting = true;
+    p->exit_status = waitstatus;
+  }
+  // joiners give up (see sys_thread_join)
+  cv_broadcast(p->p_cv, p->p_cv_lock);
+  lock_release(p->p_cv_lock);
+
+  // kick the other threads out of anything they'd sleep in for good;
+  // each checks p_exiting after waking, or before sleeping again
+  futex_wakeall(p->p_addrspace);
+  lock_acquire(p->p_waitlock);
+  cv_broadcast(p->p_waitcv, p->p_waitlock);
+  lock_release(p->p_waitlock);
+
+  // the rest leave through proc_checkexit; whoever is last out tears
+  // the process down
+  if (!uthread_leave(p, 0)) {
+    thread_exit();
+  }
+  exit_process(p);
+}
+
+// On the way back to user mode: if another thread has ended the
+// process, leave instead.
+void proc_checkexit(void) {
+  struct proc *p = curproc;
+
+  if (!p->p_exiting) {
+    return;
+  }
+  if (!uthread_leave(p, 0)) {
+    thread_exit();
+  }
+  exit_process(p);
+}
+
+// a fatal trap in user mode
+void proc_exitsig(int sig) {
+  exit_with(_MKWAIT_SIG(sig));
+}
 #endif // OPT_A2
 
 void sys__exit(int exitcode) {
 
-  struct addrspace *as;
-  struct proc *p = curproc;
+  DEBUG(DB_SYSCALL,"Syscall: _exit(%d)\n",exitcode);
 
-  /* for now, just include this to keep the compiler from complaining about
-     an unused variable */
+#if OPT_A2
+  exit_with(_MKWAIT_EXIT(exitcode));
+#else
   (void)exitcode;
+  exit_process(curproc);
+#endif
+}
 
-  DEBUG(DB_SYSCALL,"Syscall: _exit(%d)\n",exitcode);
+// Tear down the current process. Called by the last thread out.
+static void exit_process(struct proc *p) {
+
+  struct addrspace *as;
+
+#if OPT_A2
+  /* nobody is left to collect our async I/O */
+  aio_discard(p);
+#endif
+
+  /* a spawned child that failed to load never got one */
+  if (curproc->p_addrspace != NULL) {
+    as_deactivate();
+    /*
+     * clear p_addrspace before calling as_destroy. Otherwise if
+     * as_destroy sleeps (which is quite possible) when we
+     * come back we'll be calling as_activate on a
+     * half-destroyed address space. This tends to be
+     * messily fatal.
+     */
+    as = curproc_setas(NULL);
+    as_destroy(as);
+  }
 
-  KASSERT(curproc->p_addrspace != NULL);
-  as_deactivate();
-  /*
-   * clear p_addrspace before calling as_destroy. Otherwise if
-   * as_destroy sleeps (which is quite possible) when we
-   * come back we'll be calling as_activate on a
-   * half-destroyed address space. This tends to be
-   * messily fatal.
-   */
-  as = curproc_setas(NULL);
-  as_destroy(as);
+#ifdef UW
+  /* close our files now, not when the parent gets around to waiting */
+  if (p->p_filetable != NULL) {
+    filetable_destroy(p->p_filetable);
+    p->p_filetable = NULL;
+  }
+#endif
 
   /* detach this thread from its process */
   /* note: curproc cannot be used after this call */
@@ -275,37 +631,48 @@ void sys__exit(int exitcode) {
 
 #if OPT_A2
 
-  // mark proc as dead
+  // mark proc as dead, so running children reap themselves when
+  // they exit, and reap the ones that already have: nobody else
+  // can wait for them now
+  lock_acquire(p->p_waitlock);
   p->p_state = DEAD;
-  // save for parent wait
-  p->exit_status = _MKWAIT_EXIT(exitcode);
-  // wake up parent
-  cv_broadcast(p->p_cv, p->p_cv_lock);
+  struct proc* zombies = p->p_zombies;
+  p->p_zombies = NULL;
+  lock_release(p->p_waitlock);
+  while (zombies != NULL) {
+    struct proc* z = zombies;
+    zombies = z->p_sibling;
+    proc_unref(z);
+  }
 
-  lock_acquire(p_children_lock);
-  // clean up ZOMBIE children (DEAD but allocated)
-  for (unsigned int i = 0; i < array_num(p->p_children); i++) {
-    struct proc* child = array_get(p->p_children, i);
-
-    // is ZOMBIE?
-    if (child->p_state == DEAD) {
-      proc_destroy(child);
-      array_remove(p->p_children, i);
-      // since p->children is now mutated
-      i--;
+  // tell the parent. only our parent's lock is involved, so exits
+  // in unrelated process trees don't get in each other's way
+  struct proc* parent = p->p_parent;
+  bool orphan = true;
+  if (parent != NULL) {
+    lock_acquire(parent->p_waitlock);
+    struct proc** pp = &parent->p_kids;
+    while (*pp != p) {
+      KASSERT(*pp != NULL);
+      pp = &(*pp)->p_sibling;
+    }
+    *pp = p->p_sibling;
+    if (parent->p_state == ALIVE) {
+      // becomes a zombie; the parent may reap it (and p may be
+      // gone) as soon as we let go of the lock
+      p->p_sibling = parent->p_zombies;
+      parent->p_zombies = p;
+      orphan = false;
+      cv_broadcast(parent->p_waitcv, parent->p_waitlock);
     }
+    lock_release(parent->p_waitlock);
+    proc_unref(parent);
   }
-
-  // find parent first
-  lock_acquire(p_table_lock);
-  struct proc* parent = getProc(p_table, p->p_pid);
-  lock_release(p_table_lock);
-  // self destruct only when parent DNE or DEAD
-  if (parent == NULL || parent->p_state == DEAD) {
-    proc_destroy(p);
+  // nobody will wait for an orphan, so drop the reaper's reference
+  // ourselves
+  if (orphan) {
+    proc_unref(p);
   }
-
-  lock_release(p_children_lock);
 #else
   /* if this is the last user process in the system, proc_destroy()
      will wake up the kernel menu thread */
@@ -313,7 +680,7 @@ void sys__exit(int exitcode) {
 #endif
   thread_exit();
   /* thread_exit() does not return, so we should never get here */
-  panic("return from thread_exit in sys_exit\n");
+  panic("return from thread_exit in exit_process\n");
 }
 
 
@@ -331,6 +698,158 @@ sys_getpid(pid_t *retval)
   return(0);
 }
 
+#if OPT_A2
+// getpgid: process group of PID (0 means us)
+int
+sys_getpgid(pid_t pid, pid_t *retval)
+{
+  if (pid == 0) {
+    *retval = curproc->p_pgid;
+    return 0;
+  }
+  if (pid < 0) {
+    return ESRCH;
+  }
+
+  rwlock_acquire_read(p_table_lock);
+  struct proc* p = getProc(pid);
+  if (p == NULL) {
+    rwlock_release_read(p_table_lock);
+    return ESRCH;
+  }
+  *retval = p->p_pgid;
+  rwlock_release_read(p_table_lock);
+  return 0;
+}
+
+// is anybody alive in group PGID? Call with p_table_lock held.
+static bool pgid_inuse(pid_t pgid) {
+  for (struct proc* now = nextProc(PID_MIN); now != NULL;
+       now = nextProc(now->p_id + 1)) {
+    if (now->p_state == ALIVE && now->p_pgid == pgid) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// setpgid: move PID (us or one of our children; 0 means us) into
+// group PGID (0 means a new group named after PID). Joining an
+// existing group is allowed, making up a group number is not.
+// The group is also the gang used by gang scheduling.
+int
+sys_setpgid(pid_t pid, pid_t pgid)
+{
+  if (pid < 0 || pgid < 0) {
+    return EINVAL;
+  }
+  if (pid == 0) {
+    pid = curproc->p_id;
+  }
+  if (pgid == 0) {
+    pgid = pid;
+  }
+
+  rwlock_acquire_read(p_table_lock);
+  struct proc* p = getProc(pid);
+  if (p == NULL || (p != curproc && p->p_pid != curproc->p_id)) {
+    rwlock_release_read(p_table_lock);
+    return ESRCH;
+  }
+  // somebody has to be in the group already
+  if (pgid != pid && !pgid_inuse(pgid)) {
+    rwlock_release_read(p_table_lock);
+    return EPERM;
+  }
+  spinlock_acquire(&p->p_lock);
+  p->p_pgid = pgid;
+  spinlock_release(&p->p_lock);
+  rwlock_release_read(p_table_lock);
+  return 0;
+}
+#endif
+
+#if OPT_A2
+// does child match waitpid's pid argument? (a pid; -1 for any child;
+// 0 for any in our process group; -pgid for any in that group)
+static bool wait_matches(struct proc* child, pid_t pid) {
+  if (pid > 0) {
+    return child->p_id == pid;
+  }
+  if (pid == WAIT_ANY) {
+    return true;
+  }
+  if (pid == WAIT_MYPGRP) {
+    return child->p_pgid == curproc->p_pgid;
+  }
+  return child->p_pgid == -pid;
+}
+
+// Reap a child matching pid (see wait_matches), waiting for one to
+// exit unless WNOHANG is given. *retpid is 0 if WNOHANG found nothing.
+static int wait_child(pid_t pid, int options, int* exitstatus, pid_t* retpid) {
+  // only our own lists are involved, so waits in unrelated process
+  // trees don't contend with each other
+  struct proc* me = curproc;
+  struct proc* child;
+  struct proc** pp;
+
+  lock_acquire(me->p_waitlock);
+  for (;;) {
+    // an exited child we can reap?
+    for (pp = &me->p_zombies; *pp != NULL; pp = &(*pp)->p_sibling) {
+      if (wait_matches(*pp, pid)) {
+        break;
+      }
+    }
+    if (*pp != NULL) {
+      child = *pp;
+      *pp = child->p_sibling;
+      break;
+    }
+    // no; is there a running child it could be?
+    for (child = me->p_kids; child != NULL; child = child->p_sibling) {
+      if (wait_matches(child, pid)) {
+        break;
+      }
+    }
+    if (child == NULL) {
+      lock_release(me->p_waitlock);
+      return ECHILD;
+    }
+    if (options & WNOHANG) {
+      lock_release(me->p_waitlock);
+      *retpid = 0;
+      return 0;
+    }
+    // another thread is ending the process (see exit_with)
+    if (me->p_exiting) {
+      lock_release(me->p_waitlock);
+      return EINTR;
+    }
+    cv_wait(me->p_waitcv, me->p_waitlock);
+  }
+  lock_release(me->p_waitlock);
+
+  // off the list, the child is ours alone
+  *exitstatus = child->exit_status;
+  *retpid = child->p_id;
+  // child's cpu time (and its children's) now counts as ours
+  struct cpuusage cu;
+  spinlock_acquire(&child->p_lock);
+  cu = child->p_usage;
+  cpuusage_add(&cu, &child->p_cusage);
+  spinlock_release(&child->p_lock);
+  spinlock_acquire(&me->p_lock);
+  cpuusage_add(&me->p_cusage, &cu);
+  spinlock_release(&me->p_lock);
+  // drop the reaper's reference; this destroys it unless it has
+  // running children of its own
+  proc_unref(child);
+  return 0;
+}
+#endif
+
 /* stub handler for waitpid() system call                */
 
 int
@@ -351,45 +870,163 @@ sys_waitpid(pid_t pid,
      Fix this!
   */
 
-  if (options != 0) {
+  if (options & ~WNOHANG) {
     return(EINVAL);
   }
 
 #if OPT_A2
-  if (status == NULL) {
-    panic("invalid status pointer!");
-    return EFAULT;
-  }
-
-  lock_acquire(p_table_lock);
-  struct proc* child = getProc(p_table, pid);
-  lock_release(p_table_lock);
-
-  if (child == NULL) {
-    panic("no such process exists!");
-    return ESRCH;
-    // TODO: can we just compare curproc == found->parent??
-  } else if (curproc->p_id != child->p_pid) {
-    panic("no child exists!");
-    return ECHILD;
+  result = wait_child(pid, options, &exitstatus, &pid);
+  if (result) {
+    return result;
   }
-
-  lock_acquire(child->p_cv_lock);
-  // child has NOT exited (still running...)
-  while (child->p_state == ALIVE) {
-    cv_wait(child->p_cv, child->p_cv_lock);
+  if (pid == 0) {
+    // WNOHANG, and nothing has exited yet
+    *retval = 0;
+    return 0;
   }
-  exitstatus = child->exit_status;
-  lock_release(child->p_cv_lock);
 #else
   /* for now, just pretend the exitstatus is 0 */
   exitstatus = 0;
 #endif
 
-  result = copyout((void *)&exitstatus,status,sizeof(int));
-  if (result) {
-    return(result);
+  if (status != NULL) {
+    result = copyout((void *)&exitstatus,status,sizeof(int));
+    if (result) {
+      return(result);
+    }
   }
   *retval = pid;
   return(0);
 }
+
+#if OPT_A2
+// what a spawned child needs from its parent. Lives on the parent's
+// stack; the child is done with it once it posts sa_done.
+struct spawn_args {
+  char* sa_path;
+  struct argbuf* sa_args;
+  struct semaphore* sa_done;
+  int sa_result;
+};
+
+// first thing a spawned child runs: load the program into the (empty)
+// child and go to user mode, or exit with 127 if that fails
+static void spawn_start(void* data, unsigned long unused) {
+  struct spawn_args* sa = data;
+  struct addrspace* old_as;
+  vaddr_t entrypoint, stackptr;
+  size_t argc = sa->sa_args->ab_argc;
+  int result;
+
+  (void)unused;
+
+  result = load_program(sa->sa_path, sa->sa_args,
+                        &entrypoint, &stackptr, &old_as);
+  KASSERT(result || old_as == NULL);
+  // tell the parent how it went; sa is gone after this
+  sa->sa_result = result;
+  V(sa->sa_done);
+
+  if (result) {
+    exit_with(_MKWAIT_EXIT(127));
+  }
+
+  /* Warp to user mode. */
+  enter_new_process(argc, (userptr_t)stackptr,
+  		  stackptr, entrypoint);
+
+  /* enter_new_process does not return. */
+  panic("enter_new_process returned\n");
+}
+
+// fork and execv in one go. The child never gets a copy of our address
+// space: it starts out empty and the program is loaded straight into
+// it, so the cost doesn't depend on how big we are. Errors from the
+// load come back to us, as they would from execv. pgid is the child's
+// process group: -1 for ours, 0 for a new one named after the child,
+// or an existing group (as for setpgid). It is set before the child
+// first runs, so unlike a setpgid afterwards there's no window where
+// it runs in our group.
+int sys___spawn(userptr_t path, userptr_t args, pid_t pgid, pid_t* retval) {
+  struct spawn_args sa;
+  struct proc* child_p;
+  int exitstatus;
+  pid_t pid;
+  int err;
+
+  if (pgid < -1) {
+    return EINVAL;
+  }
+  if (pgid > 0) {
+    rwlock_acquire_read(p_table_lock);
+    bool found = pgid_inuse(pgid);
+    rwlock_release_read(p_table_lock);
+    if (!found) {
+      return EPERM;
+    }
+  }
+
+  err = args_copyin(args, &sa.sa_args);
+  if (err) {
+    return err;
+  }
+  err = path_copyin(path, &sa.sa_path);
+  if (err) {
+    argbuf_put(sa.sa_args);
+    return err;
+  }
+  sa.sa_done = sem_create("spawn", 0);
+  if (sa.sa_done == NULL) {
+    kfree(sa.sa_path);
+    argbuf_put(sa.sa_args);
+    return ENOMEM;
+  }
+  sa.sa_result = 0;
+
+  child_p = proc_create_runprogram(sa.sa_path);
+  if (child_p == NULL) {
+    // out of pids (or memory)
+    err = ENPROC;
+    goto done;
+  }
+  add_child(child_p);
+  if (pgid >= 0) {
+    spinlock_acquire(&child_p->p_lock);
+    child_p->p_pgid = (pgid == 0) ? child_p->p_id : pgid;
+    spinlock_release(&child_p->p_lock);
+  }
+
+  err = thread_fork(child_p->p_name, child_p, spawn_start, &sa, 0);
+  if (err) {
+    // it never ran; undo add_child and throw it away
+    lock_acquire(curproc->p_waitlock);
+    struct proc** pp = &curproc->p_kids;
+    while (*pp != child_p) {
+      pp = &(*pp)->p_sibling;
+    }
+    *pp = child_p->p_sibling;
+    lock_release(curproc->p_waitlock);
+    child_p->p_parent = NULL;
+    proc_unref(curproc);
+    proc_unref(child_p);
+    goto done;
+  }
+
+  pid = child_p->p_id;
+  P(sa.sa_done);
+  err = sa.sa_result;
+  if (err) {
+    // the child has exited, or is about to; reap it
+    wait_child(pid, 0, &exitstatus, &pid);
+  }
+  else {
+    *retval = pid;
+  }
+
+ done:
+  sem_destroy(sa.sa_done);
+  kfree(sa.sa_path);
+  argbuf_put(sa.sa_args);
+  return err;
+}
+#endif
@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/ring.h>
+#include <lib.h>
+#include <copyinout.h>
+#include <syscall.h>
+#include "opt-A2.h"
+
+/*
+ * ring_enter: run a batch of I/O requests from a process's submission
+ * ring (see kern/ring.h) for the price of one trap.
+ *
+ * The ring lives in ordinary user memory, so it comes in and goes out
+ * with copyin/copyout like any other system call argument: one copyin
+ * for the indexes, one (two if it wraps) for the submissions, the same
+ * again for the completions on the way out. Each request runs through
+ * the same code as the system call it stands for.
+ */
+
+#if OPT_A2
+
+#define RING_MASK (RING_ENTRIES - 1)
+
+/*
+ * Copy N ring entries of SIZE bytes between KBUF and the user array
+ * at UARR, starting at slot INDEX and wrapping at the end.
+ */
+static
+int
+ring_copy(userptr_t uarr, void *kbuf, unsigned index, unsigned n,
+	  size_t size, bool out)
+{
+	unsigned slot = index & RING_MASK;
+	unsigned first = n;
+	unsigned pass, count;
+	userptr_t u;
+	char *k = kbuf;
+	int result;
+
+	if (first > RING_ENTRIES - slot) {
+		first = RING_ENTRIES - slot;
+	}
+
+	for (pass = 0; pass < 2; pass++) {
+		count = pass == 0 ? first : n - first;
+		if (count == 0) {
+			continue;
+		}
+		u = (userptr_t)((char *)uarr + (pass == 0 ? slot : 0) * size);
+		if (out) {
+			result = copyout(k, u, count * size);
+		}
+		else {
+			result = copyin((const_userptr_t)u, k, count * size);
+		}
+		if (result) {
+			return result;
+		}
+		k += count * size;
+	}
+	return 0;
+}
+
+/*
+ * Carry out one request; returns what goes in the completion.
+ */
+static
+int
+ring_do(const struct ring_sqe *sqe)
+{
+	int result, ret = 0;
+
+	switch (sqe->rs_op) {
+	    case RING_NOP:
+		result = 0;
+		break;
+	    case RING_READ:
+		if (sqe->rs_off == RING_OFF_CUR) {
+			result = sys_read(sqe->rs_fd, sqe->rs_buf,
+					  sqe->rs_len, &ret);
+		}
+		else {
+			result = sys_pread(sqe->rs_fd, sqe->rs_buf,
+					   sqe->rs_len, sqe->rs_off, &ret);
+		}
+		break;
+	    case RING_WRITE:
+		if (sqe->rs_off == RING_OFF_CUR) {
+			result = sys_write(sqe->rs_fd, sqe->rs_buf,
+					   sqe->rs_len, &ret);
+		}
+		else {
+			result = sys_pwrite(sqe->rs_fd, sqe->rs_buf,
+					    sqe->rs_len, sqe->rs_off, &ret);
+		}
+		break;
+	    case RING_FSYNC:
+		result = sys_fsync(sqe->rs_fd);
+		break;
+	    default:
+		result = EINVAL;
+		break;
+	}
+	return result ? -result : ret;
+}
+
+/*
+ * Take up to COUNT submissions (0 means all there are) from the ring
+ * at URING, run them, and post their completions.
+ */
+int
+sys_ring_enter(userptr_t uring, unsigned count, int *retval)
+{
+	struct ring *r = (struct ring *)uring;
+	struct ring_index idx;
+	struct ring_sqe *sq;
+	struct ring_cqe *cq;
+	unsigned pending, room, n, i;
+	int result;
+
+	result = copyin((const_userptr_t)uring, &idx, sizeof(idx));
+	if (result) {
+		return result;
+	}
+	pending = idx.sq_tail - idx.sq_head;
+	room = RING_ENTRIES - (idx.cq_tail - idx.cq_head);
+	if (pending > RING_ENTRIES || room > RING_ENTRIES) {
+		/* the process scribbled on the indexes */
+		return EINVAL;
+	}
+
+	n = pending;
+	if (count != 0 && n > count) {
+		n = count;
+	}
+	if (n > room) {
+		if (room == 0) {
+			/* nowhere to put the results */
+			return EBUSY;
+		}
+		n = room;
+	}
+	if (n == 0) {
+		*retval = 0;
+		return 0;
+	}
+
+	sq = kmalloc(n * sizeof(*sq));
+	cq = kmalloc(n * sizeof(*cq));
+	if (sq == NULL || cq == NULL) {
+		result = ENOMEM;
+		goto out;
+	}
+
+	result = ring_copy((userptr_t)r->r_sq, sq, idx.sq_head, n,
+			   sizeof(*sq), false);
+	if (result) {
+		goto out;
+	}
+
+	for (i=0; i<n; i++) {
+		cq[i].rc_user_data = sq[i].rs_user_data;
+		cq[i].rc_res = ring_do(&sq[i]);
+	}
+
+	result = ring_copy((userptr_t)r->r_cq, cq, idx.cq_tail, n,
+			   sizeof(*cq), true);
+	if (result) {
+		goto out;
+	}
+
+	/*
+	 * Only the kernel's two indexes go back; the process may be
+	 * updating its own in another thread.
+	 */
+	idx.sq_head += n;
+	idx.cq_tail += n;
+	result = copyout(&idx.cq_tail, (userptr_t)&r->r_idx.cq_tail,
+			 sizeof(unsigned));
+	if (result) {
+		goto out;
+	}
+	result = copyout(&idx.sq_head, (userptr_t)&r->r_idx.sq_head,
+			 sizeof(unsigned));
+	if (result) {
+		goto out;
+	}
+	*retval = n;
+
+ out:
+	kfree(sq);
+	kfree(cq);
+	return result;
+}
+
+#endif /* OPT_A2 */
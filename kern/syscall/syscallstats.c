@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Per-syscall statistics: how often each system call is made, how
+ * often it fails, and a histogram of how long it takes, in cycles.
+ *
+ * Each cpu counts into its own table, with interrupts off, so the
+ * counting needs no locks and the cpus don't fight over cache lines.
+ * A call is counted on the cpu it finishes on. Latencies come from
+ * the 32-bit cycle counter and include any time spent asleep, so a
+ * call that sleeps for longer than the counter takes to wrap (a few
+ * minutes) is miscounted; on a multiprocessor, a call that moves
+ * between cpus is timed with two different counters.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <thread.h>
+#include <current.h>
+#include <syscall.h>
+
+/*
+ * Histogram buckets are powers of 2: bucket 0 is anything under
+ * 2^(SCSTATS_MINSHIFT+1) cycles, bucket b >= 1 is [2^(b+MINSHIFT),
+ * 2^(b+MINSHIFT+1)), and the last bucket takes everything above.
+ */
+#define SCSTATS_BUCKETS 16
+#define SCSTATS_MINSHIFT 8
+
+struct scstats {
+	uint32_t ss_calls;
+	uint32_t ss_errors;
+	uint64_t ss_cycles;
+	uint32_t ss_hist[SCSTATS_BUCKETS];
+};
+
+/* One table per cpu, indexed by call number */
+static struct scstats **scstats_tables;
+static unsigned scstats_ncpus;
+
+/*
+ * Set up the tables. Called once the cpus are all running, but before
+ * there are any user processes to make system calls.
+ */
+void
+syscallstats_bootstrap(void)
+{
+	unsigned i;
+
+	scstats_ncpus = thread_numcpus();
+	scstats_tables = kmalloc(scstats_ncpus * sizeof(*scstats_tables));
+	if (scstats_tables == NULL) {
+		panic("syscallstats_bootstrap: out of memory\n");
+	}
+	for (i=0; i<scstats_ncpus; i++) {
+		scstats_tables[i] =
+			kmalloc(SYSCALL_NUMS * sizeof(struct scstats));
+		if (scstats_tables[i] == NULL) {
+			panic("syscallstats_bootstrap: out of memory\n");
+		}
+		bzero(scstats_tables[i], SYSCALL_NUMS * sizeof(struct scstats));
+	}
+}
+
+static
+unsigned
+scstats_bucket(uint32_t cycles)
+{
+	unsigned b = 0;
+
+	cycles >>= SCSTATS_MINSHIFT + 1;
+	while (cycles != 0 && b < SCSTATS_BUCKETS - 1) {
+		cycles >>= 1;
+		b++;
+	}
+	return b;
+}
+
+/*
+ * Count a call to CALLNO that took CYCLES and returned ERR.
+ */
+void
+syscallstats_record(int callno, int err, uint32_t cycles)
+{
+	struct scstats *ss;
+	unsigned cpunum;
+	int spl;
+
+	if (callno < 0 || callno >= SYSCALL_NUMS) {
+		return;
+	}
+
+	spl = splhigh();
+	cpunum = curcpu->c_number;
+	if (cpunum < scstats_ncpus) {
+		ss = &scstats_tables[cpunum][callno];
+		ss->ss_calls++;
+		if (err) {
+			ss->ss_errors++;
+		}
+		ss->ss_cycles += cycles;
+		ss->ss_hist[scstats_bucket(cycles)]++;
+	}
+	splx(spl);
+}
+
+/*
+ * Print the totals over all cpus for every call that has been made,
+ * with the average time and the histogram's nonzero buckets, each
+ * labelled by its lower bound in cycles.
+ */
+void
+syscallstats_print(void)
+{
+	struct scstats sum;
+	unsigned i, b;
+	int callno;
+
+	kprintf("%-16s %8s %8s %8s  %s\n",
+		"syscall", "calls", "errors", "avg us", "cycles: count");
+	for (callno=0; callno<SYSCALL_NUMS; callno++) {
+		bzero(&sum, sizeof(sum));
+		for (i=0; i<scstats_ncpus; i++) {
+			const struct scstats *ss = &scstats_tables[i][callno];
+
+			sum.ss_calls += ss->ss_calls;
+			sum.ss_errors += ss->ss_errors;
+			sum.ss_cycles += ss->ss_cycles;
+			for (b=0; b<SCSTATS_BUCKETS; b++) {
+				sum.ss_hist[b] += ss->ss_hist[b];
+			}
+		}
+		if (sum.ss_calls == 0) {
+			continue;
+		}
+
+		kprintf("%-16s %8u %8u %8u ", syscall_name(callno),
+			sum.ss_calls, sum.ss_errors,
+			(unsigned)(sum.ss_cycles / sum.ss_calls /
+				   (CPU_CYCLES_PER_SEC / 1000000)));
+		for (b=0; b<SCSTATS_BUCKETS; b++) {
+			if (sum.ss_hist[b] != 0) {
+				kprintf(" %u:%u",
+					b == 0 ? 0 : 1U << (b+SCSTATS_MINSHIFT),
+					sum.ss_hist[b]);
+			}
+		}
+		kprintf("\n");
+	}
+}
+
+/*
+ * Clear the statistics. Other cpus may be counting calls meanwhile,
+ * so this is only approximate.
+ */
+void
+syscallstats_reset(void)
+{
+	unsigned i;
+
+	for (i=0; i<scstats_ncpus; i++) {
+		bzero(scstats_tables[i], SYSCALL_NUMS * sizeof(struct scstats));
+	}
+}
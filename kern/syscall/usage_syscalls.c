@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/time.h>
+#include <kern/resource.h>
+#include <kern/procinfo.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <thread.h>
+#include <current.h>
+#include <proc.h>
+#include <synch.h>
+#include <copyinout.h>
+#include <syscall.h>
+#include "opt-A2.h"
+
+/*
+ * CPU usage reporting: getrusage() for a process's own accounting and
+ * procinfo() for looking at everyone else's. The counters themselves
+ * are kept by the thread system (see thread_chargetime) in cycles.
+ */
+
+static
+void
+cycles_to_timeval(uint64_t cycles, struct timeval *tv)
+{
+	tv->tv_sec = cycles / CPU_CYCLES_PER_SEC;
+	tv->tv_usec = (cycles % CPU_CYCLES_PER_SEC) /
+		(CPU_CYCLES_PER_SEC / 1000000);
+}
+
+/*
+ * getrusage: RUSAGE_SELF reports the calling process, RUSAGE_CHILDREN
+ * the children it has waited for. Only the times and the context
+ * switch counts are kept; everything else comes back 0.
+ */
+int
+sys_getrusage(int who, userptr_t uusage)
+{
+	struct rusage ru;
+	struct cpuusage cu;
+	int spl;
+
+	switch (who) {
+	    case RUSAGE_SELF:
+		/* Bring our own counts up to date first */
+		spl = splhigh();
+		thread_chargetime(false);
+		splx(spl);
+		proc_getusage(curproc, &cu);
+		break;
+	    case RUSAGE_CHILDREN:
+		spinlock_acquire(&curproc->p_lock);
+		cu = curproc->p_cusage;
+		spinlock_release(&curproc->p_lock);
+		break;
+	    default:
+		return EINVAL;
+	}
+
+	bzero(&ru, sizeof(ru));
+	cycles_to_timeval(cu.cu_utime, &ru.ru_utime);
+	cycles_to_timeval(cu.cu_stime, &ru.ru_stime);
+	ru.ru_nvcsw = cu.cu_nvcsw;
+	ru.ru_nivcsw = cu.cu_nivcsw;
+
+	return copyout(&ru, uusage, sizeof(ru));
+}
+
+#if OPT_A2
+/*
+ * procinfo: report on the lowest-numbered process whose pid is at
+ * least PID. Fails with ESRCH when there are none left.
+ */
+int
+sys_procinfo(pid_t pid, userptr_t uinfo)
+{
+	struct procinfo pi;
+	struct cpuusage cu;
+	struct proc *p;
+
+	bzero(&pi, sizeof(pi));
+
+	rwlock_acquire_read(p_table_lock);
+	p = nextProc(pid);
+	if (p == NULL) {
+		rwlock_release_read(p_table_lock);
+		return ESRCH;
+	}
+
+	pi.pi_pid = p->p_id;
+	pi.pi_ppid = p->p_pid;
+	pi.pi_exited = (p->p_state == DEAD);
+	snprintf(pi.pi_name, sizeof(pi.pi_name), "%s", p->p_name);
+	proc_getusage(p, &cu);
+	spinlock_acquire(&p->p_lock);
+	pi.pi_nthreads = threadarray_num(&p->p_threads);
+	spinlock_release(&p->p_lock);
+	rwlock_release_read(p_table_lock);
+
+	cycles_to_timeval(cu.cu_utime, &pi.pi_utime);
+	cycles_to_timeval(cu.cu_stime, &pi.pi_stime);
+	cycles_to_timeval(cu.cu_waittime, &pi.pi_waittime);
+	pi.pi_nvcsw = cu.cu_nvcsw;
+	pi.pi_nivcsw = cu.cu_nivcsw;
+
+	return copyout(&pi, uinfo, sizeof(pi));
+}
+#endif /* OPT_A2 */
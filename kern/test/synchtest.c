@@ -35,6 +35,7 @@
 #include <lib.h>
 #include <clock.h>
 #include <thread.h>
+#include <current.h>
 #include <synch.h>
 #include <test.h>
 
@@ -42,6 +43,14 @@
 #define NLOCKLOOPS    120
 #define NCVLOOPS      5
 #define NTHREADS      32
+#define NTPUTLOOPS    2000
+#define NTPUTTHREADS  8
+#define NRWLOOPS      200
+#define NRWREADERS    12
+#define NRWWRITERS    4
+#define NFIFOWAITERS  4
+#define PIMEDSECS     3
+#define PILOWWORKMS   20
 
 static volatile unsigned long testval1;
 static volatile unsigned long testval2;
@@ -107,15 +116,14 @@ inititems(void)
 
 static
 void
-semtestthread(void *junk, unsigned long num)
+semtestthread(void *sem, unsigned long num)
 {
 	int i;
-	(void)junk;
 
 	/*
 	 * Only one of these should print at a time.
 	 */
-	P(testsem);
+	P(sem);
 	kprintf("Thread %2lu: ", num);
 	for (i=0; i<NSEMLOOPS; i++) {
 		kprintf("%c", (int)num+64);
@@ -127,23 +135,100 @@ semtestthread(void *junk, unsigned long num)
 #endif
 }
 
+/*
+ * FIFO semaphore ordering: put NFIFOWAITERS threads to sleep on SEM
+ * one at a time, so their arrival order is known, then V once per
+ * waiter and check each V hands off (the count stays 0) and wakes the
+ * next one in arrival order. SEM's count must be 0 going in.
+ */
+static struct thread *volatile fifo_waiter[NFIFOWAITERS];
+static unsigned long fifo_order[NFIFOWAITERS];
+static volatile unsigned fifo_nwoken;
+
+static
+void
+fifowaiter(void *sem, unsigned long num)
+{
+	fifo_waiter[num] = curthread;
+	P(sem);
+	fifo_order[fifo_nwoken++] = num;
+	V(donesem);
+#ifdef UW
+  thread_exit();
+#endif
+}
+
+static
+void
+semfifocheck(struct semaphore *sem)
+{
+	unsigned long i;
+	int result;
+
+	KASSERT(sem->sem_count == 0);
+	fifo_nwoken = 0;
+	for (i=0; i<NFIFOWAITERS; i++) {
+		fifo_waiter[i] = NULL;
+		result = thread_fork("semfifo", NULL, fifowaiter, sem, i);
+		if (result) {
+			panic("semtest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+		/* the only place it can sleep is in P */
+		while (fifo_waiter[i] == NULL ||
+		       fifo_waiter[i]->t_state != S_SLEEP) {
+			thread_yield();
+		}
+	}
+
+	for (i=0; i<NFIFOWAITERS; i++) {
+		V(sem);
+		if (sem->sem_count != 0) {
+			panic("semtest: V with a waiter left the count at "
+			      "%d\n", sem->sem_count);
+		}
+		P(donesem);
+		if (fifo_nwoken != i+1 || fifo_order[i] != i) {
+			panic("semtest: FIFO semaphore wakeup %lu went to "
+			      "thread %lu\n", i, fifo_order[i]);
+		}
+	}
+	kprintf("FIFO order ok\n");
+}
+
+/*
+ * With "fifo", runs on a FIFO (direct handoff) semaphore instead,
+ * which should also come out with its count back where it started.
+ */
 int
 semtest(int nargs, char **args)
 {
+	struct semaphore *sem;
+	bool fifo;
 	int i, result;
 
-	(void)nargs;
-	(void)args;
+	fifo = nargs > 1 && !strcmp(args[1], "fifo");
 
 	inititems();
-	kprintf("Starting semaphore test...\n");
+	sem = testsem;
+	if (fifo) {
+		sem = sem_create_fifo("fifosem", 2);
+		if (sem == NULL) {
+			panic("semtest: sem_create_fifo failed\n");
+		}
+	}
+	kprintf("Starting semaphore test%s...\n", fifo ? " (FIFO)" : "");
 	kprintf("If this hangs, it's broken: ");
-	P(testsem);
-	P(testsem);
+	P(sem);
+	P(sem);
 	kprintf("ok\n");
 
+	if (fifo) {
+		semfifocheck(sem);
+	}
+
 	for (i=0; i<NTHREADS; i++) {
-		result = thread_fork("semtest", NULL, semtestthread, NULL, i);
+		result = thread_fork("semtest", NULL, semtestthread, sem, i);
 		if (result) {
 			panic("semtest: thread_fork failed: %s\n", 
 			      strerror(result));
@@ -151,13 +236,21 @@ semtest(int nargs, char **args)
 	}
 
 	for (i=0; i<NTHREADS; i++) {
-		V(testsem);
+		V(sem);
 		P(donesem);
 	}
 
 	/* so we can run it again */
-	V(testsem);
-	V(testsem);
+	V(sem);
+	V(sem);
+
+	if (fifo) {
+		if (sem->sem_count != 2) {
+			panic("semtest: FIFO semaphore count %d, expected 2\n",
+			      sem->sem_count);
+		}
+		sem_destroy(sem);
+	}
 
 #ifdef UW
   cleanitems();
@@ -315,12 +408,13 @@ cvtest(int nargs, char **args)
 {
 
 	int i, result;
+	bool morph;
 
-	(void)nargs;
-	(void)args;
+	morph = nargs > 1 && !strcmp(args[1], "morph");
 
 	inititems();
-	kprintf("Starting CV test...\n");
+	cv_setwaitmorph(testcv, morph);
+	kprintf("Starting CV test%s...\n", morph ? " (wait morphing)" : "");
 #ifdef UW
 	kprintf("%d threads should print out in reverse order %d times.\n", NTHREADS, NCVLOOPS);
 #else
@@ -347,3 +441,429 @@ cvtest(int nargs, char **args)
 
 	return 0;
 }
+
+/*
+ * Lock throughput test. A handful of threads hammer on one lock with
+ * a very short critical section, which is the case the adaptive
+ * spinning in lock_acquire is meant for. Run with several CPUs
+ * configured in sys161.conf for it to be interesting.
+ */
+
+static struct lock *tputlock;
+static volatile unsigned long tputcount;
+
+static
+void
+locktputthread(void *junk, unsigned long num)
+{
+	int i;
+
+	(void)junk;
+	(void)num;
+
+	for (i=0; i<NTPUTLOOPS; i++) {
+		lock_acquire(tputlock);
+		tputcount++;
+		lock_release(tputlock);
+	}
+	V(donesem);
+#ifdef UW
+  thread_exit();
+#endif
+}
+
+int
+locktputtest(int nargs, char **args)
+{
+	int i, result;
+	time_t secs1, secs2;
+	uint32_t nsecs1, nsecs2;
+	unsigned long usecs;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	tputlock = lock_create("tputlock");
+	if (tputlock == NULL) {
+		panic("locktputtest: lock_create failed\n");
+	}
+	tputcount = 0;
+	kprintf("Starting lock throughput test...\n");
+
+	gettime(&secs1, &nsecs1);
+	for (i=0; i<NTPUTTHREADS; i++) {
+		result = thread_fork("locktput", NULL, locktputthread,
+				     NULL, i);
+		if (result) {
+			panic("locktputtest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NTPUTTHREADS; i++) {
+		P(donesem);
+	}
+	gettime(&secs2, &nsecs2);
+	getinterval(secs1, nsecs1, secs2, nsecs2, &secs2, &nsecs2);
+
+	if (tputcount != NTPUTTHREADS * NTPUTLOOPS) {
+		kprintf("Count is %lu, should be %d\n", tputcount,
+			NTPUTTHREADS * NTPUTLOOPS);
+		panic("locktputtest: lost updates\n");
+	}
+
+	usecs = secs2 * 1000000 + nsecs2 / 1000;
+	kprintf("%lu acquisitions in %lu us\n", tputcount, usecs);
+	kprintf("contended %u, won by spinning %u, sleeps %u\n",
+		tputlock->lk_contended, tputlock->lk_spins,
+		tputlock->lk_sleeps);
+
+	lock_destroy(tputlock);
+	tputlock = NULL;
+#ifdef UW
+  cleanitems();
+#endif
+	kprintf("Lock throughput test done.\n");
+
+	return 0;
+}
+
+/*
+ * Reader-writer lock test. Writers update a pair of values that must
+ * always agree; readers check that they agree and that no writer is
+ * inside while they are. We also record how many readers were inside
+ * at once, which should be more than one if the lock is any good.
+ */
+
+static struct rwlock *testrw;
+static volatile unsigned long rwval1;
+static volatile unsigned long rwval2;
+static volatile unsigned rwreaders;
+static volatile unsigned rwwriters;
+static volatile unsigned rwmaxreaders;
+static struct spinlock rwcount_lock = SPINLOCK_INITIALIZER;
+
+static
+void
+rwfail(const char *msg)
+{
+	kprintf("rwtest: %s\n", msg);
+	panic("rwtest: Test failed\n");
+}
+
+static
+void
+rwreaderthread(void *junk, unsigned long num)
+{
+	int i, j;
+
+	(void)junk;
+	(void)num;
+
+	for (i=0; i<NRWLOOPS; i++) {
+		rwlock_acquire_read(testrw);
+
+		spinlock_acquire(&rwcount_lock);
+		rwreaders++;
+		if (rwreaders > rwmaxreaders) {
+			rwmaxreaders = rwreaders;
+		}
+		if (rwwriters != 0) {
+			rwfail("reader inside with a writer");
+		}
+		spinlock_release(&rwcount_lock);
+
+		for (j=0; j<20; j++) {
+			if (rwval1 != rwval2) {
+				rwfail("reader saw a torn update");
+			}
+		}
+
+		spinlock_acquire(&rwcount_lock);
+		rwreaders--;
+		spinlock_release(&rwcount_lock);
+
+		rwlock_release_read(testrw);
+	}
+	V(donesem);
+#ifdef UW
+  thread_exit();
+#endif
+}
+
+static
+void
+rwwriterthread(void *junk, unsigned long num)
+{
+	int i;
+
+	(void)junk;
+
+	for (i=0; i<NRWLOOPS; i++) {
+		rwlock_acquire_write(testrw);
+
+		spinlock_acquire(&rwcount_lock);
+		rwwriters++;
+		if (rwwriters != 1 || rwreaders != 0) {
+			rwfail("writer not alone");
+		}
+		spinlock_release(&rwcount_lock);
+
+		rwval1 = num * NRWLOOPS + i;
+		thread_yield();
+		rwval2 = num * NRWLOOPS + i;
+
+		spinlock_acquire(&rwcount_lock);
+		rwwriters--;
+		spinlock_release(&rwcount_lock);
+
+		rwlock_release_write(testrw);
+	}
+	V(donesem);
+#ifdef UW
+  thread_exit();
+#endif
+}
+
+int
+rwtest(int nargs, char **args)
+{
+	int i, result;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	testrw = rwlock_create("testrw");
+	if (testrw == NULL) {
+		panic("rwtest: rwlock_create failed\n");
+	}
+	rwval1 = rwval2 = 0;
+	rwreaders = rwwriters = rwmaxreaders = 0;
+
+	kprintf("Starting rwlock test...\n");
+
+	for (i=0; i<NRWREADERS + NRWWRITERS; i++) {
+		if (i % 4 == 0) {
+			result = thread_fork("rwwriter", NULL,
+					     rwwriterthread, NULL, i);
+		}
+		else {
+			result = thread_fork("rwreader", NULL,
+					     rwreaderthread, NULL, i);
+		}
+		if (result) {
+			panic("rwtest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NRWREADERS + NRWWRITERS; i++) {
+		P(donesem);
+	}
+
+	kprintf("Most readers inside at once: %u\n", rwmaxreaders);
+
+	rwlock_destroy(testrw);
+	testrw = NULL;
+#ifdef UW
+  cleanitems();
+#endif
+	kprintf("rwlock test done.\n");
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Priority inheritance test.
+//
+// A low-priority thread takes a lock, then a pile of medium-priority
+// threads (two per CPU) start spinning for PIMEDSECS seconds, then a
+// high-priority thread asks for the lock. Without inheritance the low
+// thread can't run to release the lock until the medium threads are
+// done; with it, the high thread should get the lock right away.
+
+static struct lock *pilock;
+static struct semaphore *piheld;
+static volatile bool pihwaiting;
+static volatile unsigned pimdone;
+static unsigned pimdone_at_acquire;
+static unsigned long pilatency;
+static struct spinlock picount_lock = SPINLOCK_INITIALIZER;
+
+/*
+ * Return microseconds elapsed since SECS/NSECS.
+ */
+static
+unsigned long
+pi_usecs_since(time_t secs, uint32_t nsecs)
+{
+	time_t secs2;
+	uint32_t nsecs2;
+
+	gettime(&secs2, &nsecs2);
+	getinterval(secs, nsecs, secs2, nsecs2, &secs2, &nsecs2);
+	return secs2 * 1000000 + nsecs2 / 1000;
+}
+
+static
+void
+pilowthread(void *junk, unsigned long num)
+{
+	time_t secs;
+	uint32_t nsecs;
+
+	(void)junk;
+	(void)num;
+
+	thread_setpriority(PRI_MIN);
+	lock_acquire(pilock);
+	V(piheld);
+
+	/* Hang onto the lock until the high thread wants it, then some. */
+	while (!pihwaiting) {
+		/* spin */
+	}
+	gettime(&secs, &nsecs);
+	while (pi_usecs_since(secs, nsecs) < PILOWWORKMS * 1000) {
+		/* spin */
+	}
+
+	lock_release(pilock);
+	V(donesem);
+}
+
+static
+void
+pimedthread(void *junk, unsigned long num)
+{
+	time_t secs;
+	uint32_t nsecs;
+
+	(void)junk;
+	(void)num;
+
+	thread_setpriority(PRI_DEFAULT);
+	gettime(&secs, &nsecs);
+	while (pi_usecs_since(secs, nsecs) < PIMEDSECS * 1000000) {
+		/* spin */
+	}
+
+	spinlock_acquire(&picount_lock);
+	pimdone++;
+	spinlock_release(&picount_lock);
+	V(donesem);
+}
+
+static
+void
+pihighthread(void *junk, unsigned long num)
+{
+	time_t secs;
+	uint32_t nsecs;
+
+	(void)junk;
+	(void)num;
+
+	thread_setpriority(PRI_MAX - 1);
+	gettime(&secs, &nsecs);
+	pihwaiting = true;
+	lock_acquire(pilock);
+	pilatency = pi_usecs_since(secs, nsecs);
+	pimdone_at_acquire = pimdone;
+	lock_release(pilock);
+	V(donesem);
+}
+
+/*
+ * Run the scenario once. Returns how many medium threads had finished
+ * by the time the high thread got the lock.
+ */
+static
+unsigned
+pirun(bool inherit)
+{
+	unsigned i, nmed;
+	int result;
+
+	lock_inherit_priority = inherit;
+	pihwaiting = false;
+	pimdone = 0;
+	nmed = 2 * thread_numcpus();
+
+	result = thread_fork("pilow", NULL, pilowthread, NULL, 0);
+	if (result) {
+		panic("pitest: thread_fork failed: %s\n", strerror(result));
+	}
+	P(piheld);
+
+	for (i=0; i<nmed; i++) {
+		result = thread_fork("pimed", NULL, pimedthread, NULL, i);
+		if (result) {
+			panic("pitest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	/* Give the medium threads time to spread across the CPUs. */
+	clocksleep(1);
+
+	result = thread_fork("pihigh", NULL, pihighthread, NULL, 0);
+	if (result) {
+		panic("pitest: thread_fork failed: %s\n", strerror(result));
+	}
+	for (i=0; i<nmed + 2; i++) {
+		P(donesem);
+	}
+
+	kprintf("Inheritance %s: high thread waited %lu us, "
+		"%u of %u medium threads had finished\n",
+		inherit ? "on" : "off", pilatency, pimdone_at_acquire, nmed);
+	return pimdone_at_acquire;
+}
+
+int
+pitest(int nargs, char **args)
+{
+	int oldpri;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	pilock = lock_create("pilock");
+	if (pilock == NULL) {
+		panic("pitest: lock_create failed\n");
+	}
+	piheld = sem_create("piheld", 0);
+	if (piheld == NULL) {
+		panic("pitest: sem_create failed\n");
+	}
+
+	kprintf("Starting priority inheritance test...\n");
+
+	/* Stay above the test threads so we can keep forking them. */
+	oldpri = curthread->t_basepriority;
+	thread_setpriority(PRI_MAX);
+
+	if (pirun(false) == 0) {
+		kprintf("(No inversion without inheritance; the low thread "
+			"must have found a free CPU.)\n");
+	}
+	if (pirun(true) != 0) {
+		panic("pitest: high thread waited for medium threads\n");
+	}
+
+	lock_inherit_priority = true;
+	thread_setpriority(oldpri);
+
+	sem_destroy(piheld);
+	piheld = NULL;
+	lock_destroy(pilock);
+	pilock = NULL;
+#ifdef UW
+  cleanitems();
+#endif
+	kprintf("Priority inheritance test done.\n");
+
+	return 0;
+}
@@ -31,12 +31,18 @@
  * Thread test code.
  */
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
+#include <clock.h>
 #include <thread.h>
+#include <threadlist.h>
 #include <synch.h>
+#include <proc.h>
 #include <test.h>
+#include "opt-A2.h"
 
 #define NTHREADS  8
+#define NBENCHFORKS 2000
 
 static struct semaphore *tsem = NULL;
 
@@ -144,3 +150,171 @@ threadtest2(int nargs, char **args)
 
 	return 0;
 }
+
+/*
+ * Thread create+join benchmark: fork a trivial thread and wait for it,
+ * over and over, once with the thread cache off and once with it on.
+ */
+static
+void
+benchthread(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	V(tsem);
+}
+
+static
+unsigned long
+benchforks(unsigned count)
+{
+	time_t secs1, secs2;
+	uint32_t nsecs1, nsecs2;
+	unsigned i;
+	int result;
+
+	gettime(&secs1, &nsecs1);
+	for (i=0; i<count; i++) {
+		result = thread_fork("bench", NULL, benchthread, NULL, i);
+		if (result) {
+			panic("threadforkbench: thread_fork failed %s\n",
+			      strerror(result));
+		}
+		P(tsem);
+	}
+	gettime(&secs2, &nsecs2);
+	getinterval(secs1, nsecs1, secs2, nsecs2, &secs2, &nsecs2);
+
+	return secs2 * 1000000 + nsecs2 / 1000;
+}
+
+int
+threadforkbench(int nargs, char **args)
+{
+	unsigned count;
+	unsigned long uncached, cached;
+	bool wasenabled;
+
+	if (nargs > 2) {
+		kprintf("Usage: tt4 [count]\n");
+		return EINVAL;
+	}
+	count = nargs == 2 ? atoi(args[1]) : NBENCHFORKS;
+	if (count == 0) {
+		count = NBENCHFORKS;
+	}
+
+	init_sem();
+	kprintf("Starting thread fork benchmark (%u forks)...\n", count);
+
+	wasenabled = thread_cache_enabled;
+	thread_cache_enabled = false;
+	uncached = benchforks(count);
+	thread_cache_enabled = true;
+	/* once to fill the cache, then for real */
+	benchforks(THREAD_CACHE_MAX);
+	cached = benchforks(count);
+	thread_cache_enabled = wasenabled;
+
+	kprintf("No cache:   %lu us, %lu forks/sec\n", uncached,
+		uncached ? (unsigned long)(count * 1000000ULL / uncached) : 0);
+	kprintf("With cache: %lu us, %lu forks/sec\n", cached,
+		cached ? (unsigned long)(count * 1000000ULL / cached) : 0);
+	kprintf("Thread fork benchmark done.\n");
+
+	return 0;
+}
+
+/*
+ * Gang scheduling test: sort a run queue of stand-in threads from
+ * two process groups (and the kernel) the way schedule() does, and
+ * check each gang in turn comes out together at the front of its
+ * priority, with priority still first and everything else in order.
+ * The threads are never run, so they only need the fields the sort
+ * looks at.
+ */
+#define NGANGTHREADS 8
+
+#if OPT_A2
+static struct thread gang_threads[NGANGTHREADS];
+static struct proc gang_procs[2];
+
+static
+void
+gang_check(struct threadlist *tl, pid_t gang, const int *want)
+{
+	struct thread *t;
+	unsigned i;
+
+	thread_gangsort(tl, gang);
+	i = 0;
+	THREADLIST_FORALL(t, *tl) {
+		if (t != &gang_threads[want[i]]) {
+			panic("gangtest: gang %d: slot %u has thread %d, "
+			      "expected %d\n", (int)gang, i,
+			      (int)(t - gang_threads), want[i]);
+		}
+		i++;
+	}
+	if (i != NGANGTHREADS) {
+		panic("gangtest: gang %d: %u threads after sorting\n",
+		      (int)gang, i);
+	}
+}
+#endif
+
+int
+gangtest(int nargs, char **args)
+{
+#if OPT_A2
+	/* process group of each thread (0 is the kernel), and priority */
+	static const pid_t pgids[NGANGTHREADS] = { 5, 7, 5, 0, 7, 7, 5, 0 };
+	static const bool high[NGANGTHREADS] =
+		{ false, false, false, false, false, true, false, true };
+	/* the high-priority pair first, then the gang, then the rest */
+	static const int want7[NGANGTHREADS] = { 5, 7, 1, 4, 0, 2, 3, 6 };
+	static const int want5[NGANGTHREADS] = { 5, 7, 0, 2, 6, 1, 4, 3 };
+	struct threadlist tl;
+	struct thread *t;
+	unsigned i;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting gang scheduling test...\n");
+
+	bzero(gang_procs, sizeof(gang_procs));
+	gang_procs[0].p_pgid = 5;
+	gang_procs[1].p_pgid = 7;
+
+	threadlist_init(&tl);
+	for (i=0; i<NGANGTHREADS; i++) {
+		t = &gang_threads[i];
+		bzero(t, sizeof(*t));
+		threadlistnode_init(&t->t_listnode, t);
+		t->t_priority = high[i] ? PRI_DEFAULT + 1 : PRI_DEFAULT;
+		t->t_proc = pgids[i] == 5 ? &gang_procs[0] :
+			pgids[i] == 7 ? &gang_procs[1] : NULL;
+		threadlist_addtail(&tl, t);
+	}
+
+	gang_check(&tl, 7, want7);
+	/* the next gang's turn */
+	gang_check(&tl, 5, want5);
+	/* and with no gang, nothing moves */
+	gang_check(&tl, 0, want5);
+
+	while (threadlist_remhead(&tl) != NULL) {
+		/* nothing */
+	}
+	threadlist_cleanup(&tl);
+
+	kprintf("Gang scheduling test done.\n");
+#else
+	(void)nargs;
+	(void)args;
+	kprintf("gangtest: process groups need OPT_A2\n");
+#endif
+	return 0;
+}
@@ -53,6 +53,7 @@
  */
 #define SCHEDULE_HARDCLOCKS	4	/* Reschedule every 4 hardclocks. */
 #define MIGRATE_HARDCLOCKS	16	/* Migrate every 16 hardclocks. */
+#define GANG_HARDCLOCKS		2	/* Pick the next gang mid-slice. */
 
 /*
  * Once a second, everything waiting on lbolt is awakened by CPU 0.
@@ -116,16 +117,30 @@ void
 hardclock(void)
 {
 	/*
-	 * Collect statistics here as desired.
+	 * Collect statistics here as desired. (CPU time is charged
+	 * exactly, at traps and context switches, rather than sampled
+	 * here; see thread_chargetime.)
 	 */
 
 	curcpu->c_hardclocks++;
+	if (curcpu->c_number == 0 &&
+	    (curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) == GANG_HARDCLOCKS) {
+		thread_rotategang();
+	}
 	if ((curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) == 0) {
 		schedule();
 	}
 	if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
 		thread_consider_migration();
 	}
+	if ((curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) != 0 &&
+	    thread_ingang() && !thread_higherqueued()) {
+		/*
+		 * The favored gang keeps the CPU until the slice ends,
+		 * unless something of higher priority is waiting.
+		 */
+		return;
+	}
 	thread_yield();
 }
 
@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Scheduler trace rings.
+ *
+ * Each cpu logs into its own ring, with interrupts off, so there is
+ * only ever one writer per ring and no locking is needed on the
+ * logging path. Events about threads on other cpus (e.g. wakeups)
+ * are logged by the cpu that caused them. When a ring fills up the
+ * oldest records are overwritten.
+ *
+ * Dumping turns tracing off first; a record another cpu was in the
+ * middle of writing at that moment may come out garbled.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <thread.h>
+#include <current.h>
+#include <uio.h>
+#include <vfs.h>
+#include <vnode.h>
+#include <schedtrace.h>
+
+/* Records per cpu; 16 bytes each */
+#define SCHEDTRACE_RINGSIZE 2048
+
+struct schedtrace_ring {
+	unsigned str_next;		/* Total records ever logged */
+	struct schedtrace_record str_recs[SCHEDTRACE_RINGSIZE];
+};
+
+static struct schedtrace_ring **schedtrace_rings;
+static unsigned schedtrace_nrings;
+static volatile bool schedtrace_on;
+
+void
+schedtrace(unsigned type, struct thread *t, unsigned aux, uint32_t arg)
+{
+	struct schedtrace_ring *r;
+	struct schedtrace_record *sr;
+	unsigned cpunum;
+	int spl;
+
+	if (!schedtrace_on) {
+		return;
+	}
+
+	spl = splhigh();
+	cpunum = curcpu->c_number;
+	if (cpunum < schedtrace_nrings) {
+		r = schedtrace_rings[cpunum];
+		sr = &r->str_recs[r->str_next % SCHEDTRACE_RINGSIZE];
+		sr->sr_time = cpu_getcycles();
+		sr->sr_type = type;
+		sr->sr_cpu = cpunum;
+		sr->sr_aux = aux;
+		sr->sr_thread = (uintptr_t)t;
+		sr->sr_arg = arg;
+		r->str_next++;
+	}
+	splx(spl);
+}
+
+int
+schedtrace_start(void)
+{
+	struct schedtrace_ring **rings;
+	unsigned i, n;
+
+	schedtrace_on = false;
+
+	if (schedtrace_rings == NULL) {
+		/* All the cpus are up by the time anyone can ask */
+		n = thread_numcpus();
+		rings = kmalloc(n * sizeof(*rings));
+		if (rings == NULL) {
+			return ENOMEM;
+		}
+		for (i=0; i<n; i++) {
+			rings[i] = kmalloc(sizeof(struct schedtrace_ring));
+			if (rings[i] == NULL) {
+				while (i > 0) {
+					kfree(rings[--i]);
+				}
+				kfree(rings);
+				return ENOMEM;
+			}
+		}
+		schedtrace_rings = rings;
+		schedtrace_nrings = n;
+	}
+
+	for (i=0; i<schedtrace_nrings; i++) {
+		schedtrace_rings[i]->str_next = 0;
+	}
+	schedtrace_on = true;
+	return 0;
+}
+
+void
+schedtrace_stop(void)
+{
+	schedtrace_on = false;
+}
+
+/*
+ * Write LEN bytes from BUF to VN at *POS.
+ */
+static
+int
+schedtrace_write(struct vnode *vn, const void *buf, size_t len, off_t *pos)
+{
+	struct iovec iov;
+	struct uio ku;
+	int result;
+
+	uio_kinit(&iov, &ku, (void *)buf, len, *pos, UIO_WRITE);
+	result = VOP_WRITE(vn, &ku);
+	if (result) {
+		return result;
+	}
+	if (ku.uio_resid > 0) {
+		return ENOSPC;
+	}
+	*pos = ku.uio_offset;
+	return 0;
+}
+
+int
+schedtrace_dump(const char *path)
+{
+	struct schedtrace_header sh;
+	struct schedtrace_ring *r;
+	struct vnode *vn;
+	char *pathcopy;
+	uint32_t count;
+	unsigned i, start, len;
+	off_t pos;
+	int result;
+
+	schedtrace_on = false;
+	if (schedtrace_rings == NULL) {
+		return ENOENT;
+	}
+
+	/* vfs_open destroys the string it's passed */
+	pathcopy = kstrdup(path);
+	if (pathcopy == NULL) {
+		return ENOMEM;
+	}
+	result = vfs_open(pathcopy, O_WRONLY|O_CREAT|O_TRUNC, 0664, &vn);
+	kfree(pathcopy);
+	if (result) {
+		return result;
+	}
+
+	sh.sh_magic = SCHEDTRACE_MAGIC;
+	sh.sh_ncpus = schedtrace_nrings;
+	sh.sh_cyclehz = CPU_CYCLES_PER_SEC;
+	sh.sh_now = cpu_getcycles();
+	pos = 0;
+	result = schedtrace_write(vn, &sh, sizeof(sh), &pos);
+
+	for (i=0; i<schedtrace_nrings && !result; i++) {
+		r = schedtrace_rings[i];
+		if (r->str_next > SCHEDTRACE_RINGSIZE) {
+			/* Wrapped; the oldest record is the next to go */
+			count = SCHEDTRACE_RINGSIZE;
+			start = r->str_next % SCHEDTRACE_RINGSIZE;
+		}
+		else {
+			count = r->str_next;
+			start = 0;
+		}
+		result = schedtrace_write(vn, &count, sizeof(count), &pos);
+		if (result) {
+			break;
+		}
+
+		/* From the oldest record to the end, then wrap around */
+		len = count - start;
+		result = schedtrace_write(vn, &r->str_recs[start],
+					  len * sizeof(r->str_recs[0]), &pos);
+		if (result == 0 && start > 0) {
+			result = schedtrace_write(vn, &r->str_recs[0],
+					start * sizeof(r->str_recs[0]), &pos);
+		}
+	}
+
+	vfs_close(vn);
+	return result;
+}
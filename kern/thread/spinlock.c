@@ -41,6 +41,16 @@
  * Spinlocks.
  */
 
+/*
+ * Backoff bounds, in iterations of the wait loop in spinlock_acquire.
+ * A waiter polls lk_serving, and if it isn't its turn yet waits for
+ * (backoff * number of CPUs ahead of it) iterations before looking
+ * again, doubling backoff each time up to the maximum. Keep the
+ * maximum small: the lock is FIFO, so a waiter that oversleeps its
+ * turn holds everyone else up.
+ */
+#define SPINLOCK_BACKOFF_MIN	1
+#define SPINLOCK_BACKOFF_MAX	64
 
 /*
  * Initialize spinlock.
@@ -48,8 +58,12 @@
 void
 spinlock_init(struct spinlock *lk)
 {
-	spinlock_data_set(&lk->lk_lock, 0);
+	spinlock_data_set(&lk->lk_next, 0);
+	spinlock_data_set(&lk->lk_serving, 0);
 	lk->lk_holder = NULL;
+#if OPT_SPINSTATS
+	bzero(&lk->lk_stats, sizeof(lk->lk_stats));
+#endif
 }
 
 /*
@@ -60,20 +74,49 @@ spinlock_cleanup(struct spinlock *lk)
 {
 	DEBUG(DB_EXEC, "holder: %p\n", lk->lk_holder);
 	KASSERT(lk->lk_holder == NULL);
-	KASSERT(spinlock_data_get(&lk->lk_lock) == 0);
+	KASSERT(spinlock_data_get(&lk->lk_next) ==
+		spinlock_data_get(&lk->lk_serving));
+}
+
+#if OPT_SPINSTATS
+/*
+ * Record an acquisition in the lock's statistics. Called with the
+ * lock held, which is what protects the counters.
+ */
+static
+void
+spinlock_stats_record(struct spinlock *lk, unsigned spins)
+{
+	unsigned bucket;
+
+	lk->lk_stats.ss_acquires++;
+	if (spins == 0) {
+		return;
+	}
+	lk->lk_stats.ss_contended++;
+	bucket = 0;
+	while (spins > 0 && bucket < SPINLOCK_HISTBUCKETS - 1) {
+		spins >>= 1;
+		bucket++;
+	}
+	lk->lk_stats.ss_hist[bucket]++;
 }
+#endif
 
 /*
  * Get the lock.
  *
  * First disable interrupts (otherwise, if we get a timer interrupt we
- * might come back to this lock and deadlock), then use a machine-level
- * atomic operation to wait for the lock to be free.
+ * might come back to this lock and deadlock), then take a ticket and
+ * wait for it to come up.
  */
 void
 spinlock_acquire(struct spinlock *lk)
 {
 	struct cpu *mycpu;
+	spinlock_data_t ticket, serving;
+	unsigned backoff, spins;
+	volatile unsigned i;
 
 	splraise(IPL_NONE, IPL_HIGH);
 
@@ -88,27 +131,34 @@ spinlock_acquire(struct spinlock *lk)
 		mycpu = NULL;
 	}
 
+	/*
+	 * Fetch-and-add is the only atomic operation; after that we
+	 * just read lk_serving, which stays in our cache until the
+	 * holder bumps it.
+	 */
+	ticket = spinlock_data_fetchadd(&lk->lk_next, 1);
+	backoff = SPINLOCK_BACKOFF_MIN;
+	spins = 0;
 	while (1) {
-		/*
-		 * Do test-test-and-set, that is, read first before
-		 * doing test-and-set, to reduce bus contention.
-		 *
-		 * Test-and-set is a machine-level atomic operation
-		 * that writes 1 into the lock word and returns the
-		 * previous value. If that value was 0, the lock was
-		 * previously unheld and we now own it. If it was 1,
-		 * we don't.
-		 */
-		if (spinlock_data_get(&lk->lk_lock) != 0) {
-			continue;
+		serving = spinlock_data_get(&lk->lk_serving);
+		if (serving == ticket) {
+			break;
 		}
-		if (spinlock_data_testandset(&lk->lk_lock) != 0) {
-			continue;
+		for (i = 0; i < backoff * (ticket - serving); i++) {
+			/* nothing */
+		}
+		spins += backoff;
+		if (backoff < SPINLOCK_BACKOFF_MAX) {
+			backoff *= 2;
 		}
-		break;
 	}
 
 	lk->lk_holder = mycpu;
+#if OPT_SPINSTATS
+	spinlock_stats_record(lk, spins);
+#else
+	(void)spins;
+#endif
 }
 
 /*
@@ -123,7 +173,9 @@ spinlock_release(struct spinlock *lk)
 	}
 
 	lk->lk_holder = NULL;
-	spinlock_data_set(&lk->lk_lock, 0);
+	/* Only the holder writes lk_serving, so this needn't be atomic. */
+	spinlock_data_set(&lk->lk_serving,
+			  spinlock_data_get(&lk->lk_serving) + 1);
 	spllower(IPL_HIGH, IPL_NONE);
 }
 
@@ -140,3 +192,90 @@ spinlock_do_i_hold(struct spinlock *lk)
 	/* Assume we can read lk_holder atomically enough for this to work */
 	return (lk->lk_holder == curcpu->c_self);
 }
+
+#if OPT_SPINSTATS
+/*
+ * The locks whose statistics spinlock_stats_printall reports. Locks
+ * are registered once, as they're set up during boot, and never go
+ * away; anything past SPINSTATS_MAXLOCKS is counted but not kept.
+ */
+#define SPINSTATS_MAXLOCKS	80
+#define SPINSTATS_NAMELEN	16
+
+struct spinstats_entry {
+	struct spinlock *se_lock;
+	char se_name[SPINSTATS_NAMELEN];
+};
+
+static struct spinlock spinstats_lock = SPINLOCK_INITIALIZER;
+static struct spinstats_entry spinstats_locks[SPINSTATS_MAXLOCKS];
+static unsigned spinstats_num;
+static unsigned spinstats_dropped;
+
+/*
+ * Print contention statistics for a spinlock. The numbers are read
+ * without the lock, so they may be slightly inconsistent.
+ */
+static
+void
+spinlock_stats_print(const char *name, struct spinlock *lk)
+{
+	unsigned i;
+
+	kprintf("%-16s %10u acquires %10u contended   ", name,
+		lk->lk_stats.ss_acquires, lk->lk_stats.ss_contended);
+	for (i=0; i<SPINLOCK_HISTBUCKETS; i++) {
+		kprintf(" %u", lk->lk_stats.ss_hist[i]);
+	}
+	kprintf("\n");
+}
+#endif
+
+/*
+ * Register a lock for spinlock_stats_printall.
+ */
+void
+spinlock_stats_register(struct spinlock *lk, const char *name)
+{
+#if OPT_SPINSTATS
+	struct spinstats_entry *se;
+
+	spinlock_acquire(&spinstats_lock);
+	if (spinstats_num < SPINSTATS_MAXLOCKS) {
+		se = &spinstats_locks[spinstats_num];
+		se->se_lock = lk;
+		snprintf(se->se_name, sizeof(se->se_name), "%s", name);
+		spinstats_num++;
+	}
+	else {
+		spinstats_dropped++;
+	}
+	spinlock_release(&spinstats_lock);
+#else
+	(void)lk;
+	(void)name;
+#endif
+}
+
+/*
+ * Print the statistics of every registered lock. Entries are never
+ * changed once they're counted in spinstats_num, so this doesn't need
+ * the registry lock.
+ */
+void
+spinlock_stats_printall(void)
+{
+#if OPT_SPINSTATS
+	unsigned i, num;
+
+	num = spinstats_num;
+	for (i=0; i<num; i++) {
+		spinlock_stats_print(spinstats_locks[i].se_name,
+				     spinstats_locks[i].se_lock);
+	}
+	if (spinstats_dropped > 0) {
+		kprintf("(%u more locks not registered)\n",
+			spinstats_dropped);
+	}
+#endif
+}
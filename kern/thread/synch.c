@@ -37,9 +37,168 @@
 #include <spinlock.h>
 #include <wchan.h>
 #include <thread.h>
+#include <cpu.h>
 #include <current.h>
 #include <synch.h>
 
+/*
+ * How long, in cycles (cpu_getcycles), lock_acquire watches a lock
+ * whose holder is running on another CPU before giving up and going
+ * to sleep. This should be roughly the cost of a sleep/wakeup pair:
+ * two context switches plus the wait channel and run queue work,
+ * which comes to a couple of thousand instructions, and System/161
+ * runs about one instruction per cycle. Counting cycles rather than
+ * polls keeps the budget the same however the poll loop compiles.
+ */
+#define LOCK_SPIN_CYCLES 2000
+
+/* lk_waitprio when nobody is waiting; below any real priority. */
+#define PRI_NONE (PRI_MIN - 1)
+
+#if OPT_LOCKSTATS
+////////////////////////////////////////////////////////////
+//
+// Lock statistics.
+
+/* All lockstat records, newest first. */
+static struct lockstat *lockstats;
+static struct spinlock lockstats_lock = SPINLOCK_INITIALIZER;
+
+static
+struct lockstat *
+lockstat_find(const char *name)
+{
+        struct lockstat *ls;
+
+        KASSERT(spinlock_do_i_hold(&lockstats_lock));
+
+        for (ls = lockstats; ls != NULL; ls = ls->ls_next) {
+                if (!strcmp(ls->ls_name, name)) {
+                        return ls;
+                }
+        }
+        return NULL;
+}
+
+/*
+ * Find the record for NAME, creating it if needed. Returns NULL if
+ * out of memory, in which case the lock just doesn't get counted.
+ */
+static
+struct lockstat *
+lockstat_get(const char *name)
+{
+        struct lockstat *ls, *newls;
+
+        spinlock_acquire(&lockstats_lock);
+        ls = lockstat_find(name);
+        spinlock_release(&lockstats_lock);
+        if (ls != NULL) {
+                return ls;
+        }
+
+        /* Can't kmalloc with the list locked; allocate, then recheck. */
+        newls = kmalloc(sizeof(*newls));
+        if (newls == NULL) {
+                return NULL;
+        }
+        newls->ls_name = kstrdup(name);
+        if (newls->ls_name == NULL) {
+                kfree(newls);
+                return NULL;
+        }
+        spinlock_init(&newls->ls_lock);
+        newls->ls_acquires = 0;
+        newls->ls_contended = 0;
+        newls->ls_waitcycles = 0;
+        newls->ls_holdcycles = 0;
+        newls->ls_maxhold = 0;
+        newls->ls_cvwaits = 0;
+        newls->ls_cvwaitcycles = 0;
+
+        spinlock_acquire(&lockstats_lock);
+        ls = lockstat_find(name);
+        if (ls == NULL) {
+                newls->ls_next = lockstats;
+                lockstats = newls;
+                ls = newls;
+                newls = NULL;
+        }
+        spinlock_release(&lockstats_lock);
+
+        if (newls != NULL) {
+                /* somebody else got there first */
+                spinlock_cleanup(&newls->ls_lock);
+                kfree(newls->ls_name);
+                kfree(newls);
+        }
+        return ls;
+}
+
+void
+lockstat_print(void)
+{
+        struct lockstat *ls;
+        unsigned acquires, contended, cvwaits;
+        uint64_t wait, hold, cvwait;
+        uint32_t maxhold;
+
+        kprintf("%-24s %9s %9s %10s %10s %10s %8s %10s\n",
+                "name", "acquires", "contended", "avg wait", "avg hold",
+                "max hold", "cv waits", "avg cvwait");
+
+        spinlock_acquire(&lockstats_lock);
+        ls = lockstats;
+        spinlock_release(&lockstats_lock);
+
+        /* Records are only ever added at the head, so this is safe. */
+        for (; ls != NULL; ls = ls->ls_next) {
+                spinlock_acquire(&ls->ls_lock);
+                acquires = ls->ls_acquires;
+                contended = ls->ls_contended;
+                wait = ls->ls_waitcycles;
+                hold = ls->ls_holdcycles;
+                maxhold = ls->ls_maxhold;
+                cvwaits = ls->ls_cvwaits;
+                cvwait = ls->ls_cvwaitcycles;
+                spinlock_release(&ls->ls_lock);
+
+                if (acquires == 0 && cvwaits == 0) {
+                        continue;
+                }
+                kprintf("%-24.24s %9u %9u %10lu %10lu %10lu %8u %10lu\n",
+                        ls->ls_name, acquires, contended,
+                        acquires ? (unsigned long)(wait / acquires) : 0UL,
+                        acquires ? (unsigned long)(hold / acquires) : 0UL,
+                        (unsigned long)maxhold, cvwaits,
+                        cvwaits ? (unsigned long)(cvwait / cvwaits) : 0UL);
+        }
+        kprintf("(times are in cycles)\n");
+}
+
+void
+lockstat_reset(void)
+{
+        struct lockstat *ls;
+
+        spinlock_acquire(&lockstats_lock);
+        ls = lockstats;
+        spinlock_release(&lockstats_lock);
+
+        for (; ls != NULL; ls = ls->ls_next) {
+                spinlock_acquire(&ls->ls_lock);
+                ls->ls_acquires = 0;
+                ls->ls_contended = 0;
+                ls->ls_waitcycles = 0;
+                ls->ls_holdcycles = 0;
+                ls->ls_maxhold = 0;
+                ls->ls_cvwaits = 0;
+                ls->ls_cvwaitcycles = 0;
+                spinlock_release(&ls->ls_lock);
+        }
+}
+#endif /* OPT_LOCKSTATS */
+
 ////////////////////////////////////////////////////////////
 //
 // Semaphore.
@@ -71,10 +230,23 @@ sem_create(const char *name, int initial_count)
 
 	spinlock_init(&sem->sem_lock);
         sem->sem_count = initial_count;
+	sem->sem_fifo = false;
 
         return sem;
 }
 
+struct semaphore *
+sem_create_fifo(const char *name, int initial_count)
+{
+	struct semaphore *sem;
+
+	sem = sem_create(name, initial_count);
+	if (sem != NULL) {
+		sem->sem_fifo = true;
+	}
+	return sem;
+}
+
 void
 sem_destroy(struct semaphore *sem)
 {
@@ -101,6 +273,24 @@ P(struct semaphore *sem)
         KASSERT(curthread->t_in_interrupt == false);
 
 	spinlock_acquire(&sem->sem_lock);
+	if (sem->sem_fifo && sem->sem_count == 0) {
+		/*
+		 * Get in line. V hands the unit to whoever has waited
+		 * longest rather than adding it to the count, so once
+		 * we're woken up it's already ours. (And while anyone
+		 * is waiting the count stays 0, so nobody can cut in.)
+		 */
+		wchan_lock(sem->sem_wchan);
+		spinlock_release(&sem->sem_lock);
+		wchan_sleep(sem->sem_wchan);
+		/*
+		 * The V that woke us may still hold sem_lock. Wait it
+		 * out, so a caller can P and then sem_destroy safely.
+		 */
+		spinlock_acquire(&sem->sem_lock);
+		spinlock_release(&sem->sem_lock);
+		return;
+	}
         while (sem->sem_count == 0) {
 		/*
 		 * Bridge to the wchan lock, so if someone else comes
@@ -136,6 +326,15 @@ V(struct semaphore *sem)
 
 	spinlock_acquire(&sem->sem_lock);
 
+	if (sem->sem_fifo) {
+		/* Direct handoff; the count only goes up if nobody's waiting */
+		if (!wchan_wakeone(sem->sem_wchan)) {
+			sem->sem_count++;
+		}
+		spinlock_release(&sem->sem_lock);
+		return;
+	}
+
         sem->sem_count++;
         KASSERT(sem->sem_count > 0);
 	wchan_wakeone(sem->sem_wchan);
@@ -175,6 +374,17 @@ lock_create(const char *name)
       	spinlock_init(&lock->spin);
 
         lock->owner = NULL;
+        lock->lk_acquires = 0;
+        lock->lk_contended = 0;
+        lock->lk_spins = 0;
+        lock->lk_sleeps = 0;
+        lock->lk_waiters = 0;
+        lock->lk_waitprio = PRI_NONE;
+        lock->lk_nextheld = NULL;
+#if OPT_LOCKSTATS
+        lock->lk_stat = lockstat_get(name);
+        lock->lk_acquiretime = 0;
+#endif
 
         return lock;
 }
@@ -185,6 +395,7 @@ lock_destroy(struct lock *lock)
         KASSERT(lock != NULL);
 
         // add stuff here as needed
+        KASSERT(lock->lk_waiters == 0);
         lock->owner = NULL;
         spinlock_cleanup(&lock->spin);
       	wchan_destroy(lock->wch);
@@ -192,23 +403,233 @@ lock_destroy(struct lock *lock)
         kfree(lock);
 }
 
+////////////////////////////////////////////////////////////
+//
+// Priority inheritance.
+
+bool lock_inherit_priority = true;
+
+/*
+ * Protects t_priority and t_blockedon in all threads and lk_waitprio
+ * in all locks. Order: lock->spin, then this, then wchan and run
+ * queue locks.
+ */
+static struct spinlock pi_lock = SPINLOCK_INITIALIZER;
+
+/*
+ * Lend priority PRI to the holder of LOCK, then to the holder of the
+ * lock that thread is sleeping on, and so on down the chain, stopping
+ * at the first thread already at PRI or above. Raised threads that
+ * are sitting on a run queue move up at the next schedule().
+ *
+ * The caller holds LOCK's spinlock, so its owner can't change under
+ * us. Further down the chain each lock has a waiter (the previous
+ * owner), and lock_release takes pi_lock for locks with waiters, so
+ * those owners can't finish releasing (or exit) while we look.
+ */
+static
+void
+lock_donate(struct lock *lock, int pri)
+{
+        struct thread *owner;
+
+        KASSERT(spinlock_do_i_hold(&pi_lock));
+
+        while (lock != NULL) {
+                if (lock->lk_waitprio < pri) {
+                        lock->lk_waitprio = pri;
+                }
+                owner = lock->owner;
+                if (owner == NULL || owner->t_priority >= pri) {
+                        break;
+                }
+                owner->t_priority = pri;
+                lock = owner->t_blockedon;
+        }
+}
+
+/*
+ * Recompute curthread's effective priority: the base priority, or
+ * the best waiter on any lock it still holds.
+ */
+static
+void
+lock_restorepriority(void)
+{
+        struct lock *lock;
+        int pri;
+
+        KASSERT(spinlock_do_i_hold(&pi_lock));
+
+        pri = curthread->t_basepriority;
+        for (lock = curthread->t_heldlocks; lock != NULL;
+             lock = lock->lk_nextheld) {
+                if (lock->lk_waitprio > pri) {
+                        pri = lock->lk_waitprio;
+                }
+        }
+        curthread->t_priority = pri;
+}
+
+void
+lock_updatepriority(void)
+{
+        spinlock_acquire(&pi_lock);
+        lock_restorepriority();
+        spinlock_release(&pi_lock);
+}
+
+/*
+ * Take LOCK off curthread's list of held locks. Only the owner ever
+ * touches the list, so this needs no locking.
+ */
+static
+void
+lock_unlinkheld(struct lock *lock)
+{
+        struct lock **lp;
+
+        for (lp = &curthread->t_heldlocks; *lp != lock;
+             lp = &(*lp)->lk_nextheld) {
+                KASSERT(*lp != NULL);
+        }
+        *lp = lock->lk_nextheld;
+        lock->lk_nextheld = NULL;
+}
+
+/*
+ * Check if the holder of LOCK is currently running on some other CPU,
+ * in which case it is likely to release the lock soon and it's cheaper
+ * to spin than to sleep. Must be called with lock->spin held; that
+ * keeps the owner from releasing the lock (and possibly exiting)
+ * while we look at it.
+ */
+static
+bool
+lock_owner_running(struct lock *lock)
+{
+        struct thread *owner;
+
+        KASSERT(spinlock_do_i_hold(&lock->spin));
+
+        owner = lock->owner;
+        return owner != NULL && owner->t_state == S_RUN &&
+                owner->t_cpu != curcpu->c_self;
+}
+
 void
 lock_acquire(struct lock *lock)
 {
         // Write this
+        uint32_t spun, spunbefore, spinstart;
+        bool slept, contended;
+#if OPT_LOCKSTATS
+        uint32_t start, now;
+        struct lockstat *ls;
+
+        start = cpu_getcycles();
+#endif
+
         KASSERT(lock != NULL);
         KASSERT(!lock_do_i_hold(lock));
 
+        spun = 0;
+        slept = false;
+
         spinlock_acquire(&lock->spin);
+        if (curthread->t_blockedon == lock) {
+          /*
+           * cv_broadcast moved us onto this lock's queue and
+           * lock_release has now woken us; stop counting as a
+           * waiter before having a go at the lock.
+           */
+          spinlock_acquire(&pi_lock);
+          curthread->t_blockedon = NULL;
+          lock->lk_waiters--;
+          if (lock->lk_waiters == 0) {
+            lock->lk_waitprio = PRI_NONE;
+          }
+          spinlock_release(&pi_lock);
+        }
+        lock->lk_acquires++;
+        contended = lock->held;
+        if (contended) {
+          lock->lk_contended++;
+        }
         while (lock->held) {
+          if (spun < LOCK_SPIN_CYCLES && lock_owner_running(lock)) {
+            /*
+             * Adaptive spin: the holder is on another CPU, so just
+             * watch the flag for a while without the spinlock
+             * instead of paying for two context switches. The
+             * budget covers all the rounds of one acquire.
+             */
+            spinlock_release(&lock->spin);
+            spunbefore = spun;
+            spinstart = cpu_getcycles();
+            while (lock->held && spun < LOCK_SPIN_CYCLES) {
+              /* at least 1, so a spin is counted in lk_spins */
+              spun = spunbefore + (cpu_getcycles() - spinstart) + 1;
+            }
+            spinlock_acquire(&lock->spin);
+            continue;
+          }
+          lock->lk_sleeps++;
+          slept = true;
+          lock->lk_waiters++;
+          spinlock_acquire(&pi_lock);
+          curthread->t_blockedon = lock;
+          if (lock_inherit_priority) {
+            lock_donate(lock, curthread->t_priority);
+          }
+          spinlock_release(&pi_lock);
           wchan_lock(lock->wch);
           spinlock_release(&lock->spin);
           wchan_sleep(lock->wch);
           spinlock_acquire(&lock->spin);
+          spinlock_acquire(&pi_lock);
+          curthread->t_blockedon = NULL;
+          lock->lk_waiters--;
+          if (lock->lk_waiters == 0) {
+            lock->lk_waitprio = PRI_NONE;
+          }
+          spinlock_release(&pi_lock);
+        }
+        if (spun > 0 && !slept) {
+          lock->lk_spins++;
         }
         lock->held = true;
         lock->owner = curthread;
+        lock->lk_nextheld = curthread->t_heldlocks;
+        curthread->t_heldlocks = lock;
+        if (lock->lk_waiters > 0 && lock_inherit_priority) {
+          /* Pick up what the remaining waiters lent the last holder. */
+          spinlock_acquire(&pi_lock);
+          if (lock->lk_waitprio > curthread->t_priority) {
+            curthread->t_priority = lock->lk_waitprio;
+          }
+          spinlock_release(&pi_lock);
+        }
+#if OPT_LOCKSTATS
+        now = cpu_getcycles();
+        lock->lk_acquiretime = now;
+#endif
         spinlock_release(&lock->spin);
+
+#if OPT_LOCKSTATS
+        ls = lock->lk_stat;
+        if (ls != NULL) {
+          spinlock_acquire(&ls->ls_lock);
+          ls->ls_acquires++;
+          if (contended) {
+            ls->ls_contended++;
+          }
+          ls->ls_waitcycles += now - start;
+          spinlock_release(&ls->ls_lock);
+        }
+#else
+        (void)contended;
+#endif
         // (void)lock;  // suppress warning until code gets written
 }
 
@@ -216,12 +637,45 @@ void
 lock_release(struct lock *lock)
 {
         // Write this
+#if OPT_LOCKSTATS
+        uint32_t held;
+        struct lockstat *ls;
+#endif
+
         KASSERT(lock_do_i_hold(lock));
 
+#if OPT_LOCKSTATS
+        held = cpu_getcycles() - lock->lk_acquiretime;
+        ls = lock->lk_stat;
+        if (ls != NULL) {
+          spinlock_acquire(&ls->ls_lock);
+          ls->ls_holdcycles += held;
+          if (held > ls->ls_maxhold) {
+            ls->ls_maxhold = held;
+          }
+          spinlock_release(&ls->ls_lock);
+        }
+#endif
+
         spinlock_acquire(&lock->spin);
         lock->held = false;
         lock->owner = NULL;
-        wchan_wakeone(lock->wch);
+        lock_unlinkheld(lock);
+        if (lock->lk_waiters > 0) {
+          /*
+           * Wake the best waiter, then drop whatever priority the
+           * waiters lent us through this lock. The ones still asleep
+           * lend it to whoever gets the lock next.
+           */
+          wchan_wakeone(lock->wch);
+          spinlock_acquire(&pi_lock);
+          lock->lk_waitprio = wchan_maxpriority(lock->wch, PRI_NONE);
+          lock_restorepriority();
+          spinlock_release(&pi_lock);
+        }
+        else if (curthread->t_priority != curthread->t_basepriority) {
+          lock_updatepriority();
+        }
         spinlock_release(&lock->spin);
         // (void)lock;  // suppress warning until code gets written
 }
@@ -263,6 +717,10 @@ cv_create(const char *name)
       		kfree(cv);
       		return NULL;
       	}
+        cv->cv_waitmorph = false;
+#if OPT_LOCKSTATS
+        cv->cv_stat = lockstat_get(name);
+#endif
 
         return cv;
 }
@@ -282,13 +740,31 @@ void
 cv_wait(struct cv *cv, struct lock *lock)
 {
         // Write this
+#if OPT_LOCKSTATS
+        uint32_t start, slept;
+        struct lockstat *ls;
+#endif
+
         KASSERT(cv != NULL);
         KASSERT(lock != NULL);
         KASSERT(lock_do_i_hold(lock));
 
         wchan_lock(cv->wch);
         lock_release(lock);
+#if OPT_LOCKSTATS
+        start = cpu_getcycles();
+#endif
         wchan_sleep(cv->wch);
+#if OPT_LOCKSTATS
+        slept = cpu_getcycles() - start;
+        ls = cv->cv_stat;
+        if (ls != NULL) {
+          spinlock_acquire(&ls->ls_lock);
+          ls->ls_cvwaits++;
+          ls->ls_cvwaitcycles += slept;
+          spinlock_release(&ls->ls_lock);
+        }
+#endif
         lock_acquire(lock);
         // (void)cv;    // suppress warning until code gets written
         // (void)lock;  // suppress warning until code gets written
@@ -310,10 +786,216 @@ void
 cv_broadcast(struct cv *cv, struct lock *lock)
 {
 	// Write this
+  struct thread *t;
+
   KASSERT(cv != NULL);
   KASSERT(lock != NULL);
 
-  wchan_wakeall(cv->wch);
+  if (!cv->cv_waitmorph) {
+    wchan_wakeall(cv->wch);
+    return;
+  }
+  KASSERT(lock_do_i_hold(lock));
+
+  /*
+   * Requeue everyone onto the lock, as if each had gone to sleep in
+   * lock_acquire: count them as waiters and have them lend us their
+   * priority. t_blockedon tells lock_acquire (which cv_wait calls
+   * once they're woken) to undo the count.
+   */
+  spinlock_acquire(&lock->spin);
+  while ((t = wchan_requeueone(cv->wch, lock->wch)) != NULL) {
+    lock->lk_waiters++;
+    spinlock_acquire(&pi_lock);
+    t->t_blockedon = lock;
+    if (lock_inherit_priority) {
+      lock_donate(lock, t->t_priority);
+    }
+    spinlock_release(&pi_lock);
+  }
+  spinlock_release(&lock->spin);
 	// (void)cv;    // suppress warning until code gets written
 	// (void)lock;  // suppress warning until code gets written
 }
+
+void
+cv_setwaitmorph(struct cv *cv, bool on)
+{
+  KASSERT(cv != NULL);
+  cv->cv_waitmorph = on;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Reader-writer lock.
+
+struct rwlock *
+rwlock_create(const char *name)
+{
+	struct rwlock *rw;
+
+	rw = kmalloc(sizeof(struct rwlock));
+	if (rw == NULL) {
+		return NULL;
+	}
+
+	rw->rwlock_name = kstrdup(name);
+	if (rw->rwlock_name == NULL) {
+		kfree(rw);
+		return NULL;
+	}
+
+	rw->rw_readwchan = wchan_create(rw->rwlock_name);
+	if (rw->rw_readwchan == NULL) {
+		kfree(rw->rwlock_name);
+		kfree(rw);
+		return NULL;
+	}
+
+	rw->rw_writewchan = wchan_create(rw->rwlock_name);
+	if (rw->rw_writewchan == NULL) {
+		wchan_destroy(rw->rw_readwchan);
+		kfree(rw->rwlock_name);
+		kfree(rw);
+		return NULL;
+	}
+
+	spinlock_init(&rw->rw_lock);
+	rw->rw_readers = 0;
+	rw->rw_writer = NULL;
+	rw->rw_waitreaders = 0;
+	rw->rw_waitwriters = 0;
+	rw->rw_readgrants = 0;
+	rw->rw_writegrant = false;
+
+	return rw;
+}
+
+void
+rwlock_destroy(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+	KASSERT(rw->rw_readers == 0);
+	KASSERT(rw->rw_writer == NULL);
+	KASSERT(rw->rw_waitreaders == 0 && rw->rw_waitwriters == 0);
+
+	/* wchan_cleanup will assert if anyone's waiting on it */
+	spinlock_cleanup(&rw->rw_lock);
+	wchan_destroy(rw->rw_writewchan);
+	wchan_destroy(rw->rw_readwchan);
+	kfree(rw->rwlock_name);
+	kfree(rw);
+}
+
+void
+rwlock_acquire_read(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+	KASSERT(rw->rw_writer != curthread);
+
+	spinlock_acquire(&rw->rw_lock);
+	if (rw->rw_writer == NULL && rw->rw_waitwriters == 0 &&
+	    !rw->rw_writegrant) {
+		rw->rw_readers++;
+		spinlock_release(&rw->rw_lock);
+		return;
+	}
+
+	/*
+	 * Wait for the writer ahead of us to let us in. Whoever grants
+	 * us the lock also counts us in rw_readers, so all we have to
+	 * do when we wake up is consume the grant.
+	 */
+	rw->rw_waitreaders++;
+	do {
+		wchan_lock(rw->rw_readwchan);
+		spinlock_release(&rw->rw_lock);
+		wchan_sleep(rw->rw_readwchan);
+		spinlock_acquire(&rw->rw_lock);
+	} while (rw->rw_readgrants == 0);
+	rw->rw_readgrants--;
+	KASSERT(rw->rw_readers > 0);
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_read(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_readers > 0);
+	KASSERT(rw->rw_writer == NULL);
+	rw->rw_readers--;
+	if (rw->rw_readers == 0 && rw->rw_waitwriters > 0) {
+		/* Last reader out hands the lock to the oldest writer. */
+		rw->rw_waitwriters--;
+		rw->rw_writegrant = true;
+		wchan_wakeone(rw->rw_writewchan);
+	}
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_acquire_write(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+	KASSERT(rw->rw_writer != curthread);
+
+	spinlock_acquire(&rw->rw_lock);
+	if (rw->rw_writer == NULL && rw->rw_readers == 0 &&
+	    rw->rw_waitwriters == 0 && !rw->rw_writegrant) {
+		rw->rw_writer = curthread;
+		spinlock_release(&rw->rw_lock);
+		return;
+	}
+
+	rw->rw_waitwriters++;
+	do {
+		wchan_lock(rw->rw_writewchan);
+		spinlock_release(&rw->rw_lock);
+		wchan_sleep(rw->rw_writewchan);
+		spinlock_acquire(&rw->rw_lock);
+	} while (!rw->rw_writegrant);
+	rw->rw_writegrant = false;
+	KASSERT(rw->rw_writer == NULL);
+	KASSERT(rw->rw_readers == 0);
+	rw->rw_writer = curthread;
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_write(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_writer == curthread);
+	rw->rw_writer = NULL;
+	if (rw->rw_waitreaders > 0) {
+		/*
+		 * Let in every reader that queued up behind us, as a
+		 * batch, before the next writer gets a turn.
+		 */
+		rw->rw_readers += rw->rw_waitreaders;
+		rw->rw_readgrants += rw->rw_waitreaders;
+		rw->rw_waitreaders = 0;
+		wchan_wakeall(rw->rw_readwchan);
+	}
+	else if (rw->rw_waitwriters > 0) {
+		rw->rw_waitwriters--;
+		rw->rw_writegrant = true;
+		wchan_wakeone(rw->rw_writewchan);
+	}
+	spinlock_release(&rw->rw_lock);
+}
+
+bool
+rwlock_do_i_hold_write(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+
+	return rw->rw_writer == curthread;
+}
@@ -32,12 +32,15 @@
  */
 
 #define THREADINLINE
+#define ATOMIC_INLINE	/* empty; build the out-of-line copies here */
 
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
 #include <array.h>
+#include <atomic.h>
 #include <cpu.h>
+#include <clock.h>
 #include <spl.h>
 #include <spinlock.h>
 #include <wchan.h>
@@ -50,6 +53,7 @@
 #include <addrspace.h>
 #include <mainbus.h>
 #include <vnode.h>
+#include <schedtrace.h>
 
 #include "opt-synchprobs.h"
 
@@ -112,34 +116,50 @@ thread_checkstack(struct thread *thread)
 }
 
 /*
- * Create a thread. This is used both to create a first thread
- * for each CPU and to create subsequent forked threads.
+ * Set a thread's name, in t_namebuf if it fits.
  */
 static
-struct thread *
-thread_create(const char *name)
+int
+thread_setname(struct thread *thread, const char *name)
 {
-	struct thread *thread;
-
-	DEBUGASSERT(name != NULL);
-
-	thread = kmalloc(sizeof(*thread));
-	if (thread == NULL) {
-		return NULL;
+	if (strlen(name) < sizeof(thread->t_namebuf)) {
+		strcpy(thread->t_namebuf, name);
+		thread->t_name = thread->t_namebuf;
+	}
+	else {
+		thread->t_name = kstrdup(name);
+		if (thread->t_name == NULL) {
+			return ENOMEM;
+		}
 	}
+	return 0;
+}
 
-	thread->t_name = kstrdup(name);
-	if (thread->t_name == NULL) {
-		kfree(thread);
-		return NULL;
+static
+void
+thread_freename(struct thread *thread)
+{
+	if (thread->t_name != thread->t_namebuf) {
+		kfree(thread->t_name);
 	}
+	thread->t_name = NULL;
+}
+
+/*
+ * Initialize everything in a thread except its name and stack. Used
+ * for new threads and for threads coming out of the cpu's cache.
+ */
+static
+void
+thread_initfields(struct thread *thread)
+{
 	thread->t_wchan_name = "NEW";
 	thread->t_state = S_READY;
 
 	/* Thread subsystem fields */
 	thread_machdep_init(&thread->t_machdep);
 	threadlistnode_init(&thread->t_listnode, thread);
-	thread->t_stack = NULL;
+	thread->t_inboxnext = NULL;
 	thread->t_context = NULL;
 	thread->t_cpu = NULL;
 	thread->t_proc = NULL;
@@ -149,7 +169,45 @@ thread_create(const char *name)
 	thread->t_curspl = IPL_HIGH;
 	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
 
+	/* Scheduling priority */
+	thread->t_priority = PRI_DEFAULT;
+	thread->t_basepriority = PRI_DEFAULT;
+	thread->t_blockedon = NULL;
+	thread->t_heldlocks = NULL;
+
+	/* CPU accounting */
+	bzero(&thread->t_usage, sizeof(thread->t_usage));
+	thread->t_stamp = cpu_getcycles();
+
+	/* Public fields */
+	thread->t_uthread = NULL;
+
 	/* If you add to struct thread, be sure to initialize here */
+}
+
+/*
+ * Create a thread. This is used both to create a first thread
+ * for each CPU and to create subsequent forked threads.
+ */
+static
+struct thread *
+thread_create(const char *name)
+{
+	struct thread *thread;
+
+	DEBUGASSERT(name != NULL);
+
+	thread = kmalloc(sizeof(*thread));
+	if (thread == NULL) {
+		return NULL;
+	}
+
+	if (thread_setname(thread, name)) {
+		kfree(thread);
+		return NULL;
+	}
+	thread->t_stack = NULL;
+	thread_initfields(thread);
 
 	return thread;
 }
@@ -179,12 +237,18 @@ cpu_create(unsigned hardware_number)
 
 	c->c_curthread = NULL;
 	threadlist_init(&c->c_zombies);
+	threadlist_init(&c->c_threadcache);
 	c->c_hardclocks = 0;
+	c->c_idlecycles = 0;
+	c->c_idleperiods = 0;
+	c->c_idlesince = 0;
 
 	c->c_isidle = false;
 	threadlist_init(&c->c_runqueue);
 	spinlock_init(&c->c_runqueue_lock);
 
+	c->c_inbox = NULL;
+
 	c->c_ipi_pending = 0;
 	c->c_numshootdown = 0;
 	spinlock_init(&c->c_ipi_lock);
@@ -194,6 +258,11 @@ cpu_create(unsigned hardware_number)
 		panic("cpu_create: array_add: %s\n", strerror(result));
 	}
 
+	snprintf(namebuf, sizeof(namebuf), "cpu%u runqueue", c->c_number);
+	spinlock_stats_register(&c->c_runqueue_lock, namebuf);
+	snprintf(namebuf, sizeof(namebuf), "cpu%u ipi", c->c_number);
+	spinlock_stats_register(&c->c_ipi_lock, namebuf);
+
 	snprintf(namebuf, sizeof(namebuf), "<boot #%d>", c->c_number);
 	c->c_curthread = thread_create(namebuf);
 	if (c->c_curthread == NULL) {
@@ -227,6 +296,26 @@ cpu_create(unsigned hardware_number)
 	return c;
 }
 
+/*
+ * Add a thread to a run queue or wait channel list, behind every
+ * thread of the same or higher priority. Searches from the tail, so
+ * when everyone has the same priority this is just addtail.
+ */
+static
+void
+thread_enqueue(struct threadlist *tl, struct thread *t)
+{
+	struct thread *prev;
+
+	THREADLIST_FORALL_REV(prev, *tl) {
+		if (prev->t_priority >= t->t_priority) {
+			threadlist_insertafter(tl, prev, t);
+			return;
+		}
+	}
+	threadlist_addhead(tl, t);
+}
+
 /*
  * Destroy a thread.
  *
@@ -258,10 +347,86 @@ thread_destroy(struct thread *thread)
 	/* sheer paranoia */
 	thread->t_wchan_name = "DESTROYED";
 
-	kfree(thread->t_name);
+	thread_freename(thread);
 	kfree(thread);
 }
 
+////////////////////////////////////////////////////////////
+
+/*
+ * Per-cpu cache of exited threads.
+ *
+ * Rather than freeing a zombie's thread structure and stack, exorcise()
+ * parks up to THREAD_CACHE_MAX of them on the cpu's c_threadcache, and
+ * thread_fork() takes one from there before going to kmalloc. The
+ * stack guard band is checked on the way in and left in place.
+ *
+ * The cache is per-cpu and only touched with interrupts off, so it
+ * needs no lock.
+ */
+
+bool thread_cache_enabled = true;
+
+/*
+ * Try to cache zombie Z. Returns false if it should be destroyed
+ * instead.
+ */
+static
+bool
+thread_cache_put(struct thread *z)
+{
+	KASSERT(curthread->t_curspl > 0);
+	KASSERT(z->t_proc == NULL);
+
+	if (!thread_cache_enabled || z->t_stack == NULL ||
+	    curcpu->c_threadcache.tl_count >= THREAD_CACHE_MAX) {
+		return false;
+	}
+
+	thread_checkstack(z);
+	thread_machdep_cleanup(&z->t_machdep);
+	thread_freename(z);
+	z->t_wchan_name = "CACHED";
+	/* LIFO, so the most recently used stack gets reused first */
+	threadlist_addhead(&curcpu->c_threadcache, z);
+	return true;
+}
+
+/*
+ * Get a thread from this cpu's cache and set it up as if by
+ * thread_create, or return NULL if there isn't one. The stack comes
+ * with it.
+ */
+static
+struct thread *
+thread_cache_get(const char *name)
+{
+	struct thread *thread;
+	int spl;
+
+	if (!thread_cache_enabled) {
+		return NULL;
+	}
+
+	/* Interrupts off so we can't be switched to another cpu */
+	spl = splhigh();
+	thread = threadlist_remhead(&curcpu->c_threadcache);
+	splx(spl);
+	if (thread == NULL) {
+		return NULL;
+	}
+
+	if (thread_setname(thread, name)) {
+		/* Put it back; it's still usable */
+		spl = splhigh();
+		threadlist_addhead(&curcpu->c_threadcache, thread);
+		splx(spl);
+		return NULL;
+	}
+	thread_initfields(thread);
+	return thread;
+}
+
 /*
  * Clean up zombies. (Zombies are threads that have exited but still
  * need to have thread_destroy called on them.)
@@ -277,7 +442,9 @@ exorcise(void)
 	while ((z = threadlist_remhead(&curcpu->c_zombies)) != NULL) {
 		KASSERT(z != curthread);
 		KASSERT(z->t_state == S_ZOMBIE);
-		thread_destroy(z);
+		if (!thread_cache_put(z)) {
+			thread_destroy(z);
+		}
 	}
 }
 
@@ -426,10 +593,212 @@ thread_start_cpus(void)
 	cpu_startup_sem = NULL;
 }
 
+/*
+ * Push a chain of threads onto another cpu's wakeup inbox. The chain
+ * runs from FIRST to LAST through t_inboxnext, newest first, the same
+ * way the inbox itself is kept; a single thread is FIRST == LAST.
+ *
+ * The inbox is a lock-free stack: any number of cpus can push onto
+ * it with compare-and-swap, and only the owning cpu ever takes
+ * anything off, by swapping out the whole list at once (see
+ * thread_inbox_drain). Since nobody pops single entries there is no
+ * ABA problem.
+ *
+ * Only the push that finds the inbox empty sends an IPI, and only if
+ * the cpu is idle; anyone pushing behind it rides on the same
+ * interrupt. If the cpu wasn't idle it will drain the inbox at its
+ * next thread_switch. (If it goes idle in the meantime, it sets
+ * c_isidle before draining, so either it sees our threads or we see
+ * c_isidle.)
+ */
+static
+void
+thread_inbox_push(struct cpu *c, struct thread *first, struct thread *last)
+{
+	struct thread *head;
+
+	do {
+		head = c->c_inbox;
+		last->t_inboxnext = head;
+	} while (atomic_cas_ptr((void *volatile *)&c->c_inbox,
+				head, first) != head);
+
+	if (head == NULL && c->c_isidle) {
+		ipi_send(c, IPI_UNIDLE);
+	}
+}
+
+/*
+ * Move everything in the current cpu's inbox to its run queue. The
+ * inbox comes out newest first, so reverse it to enqueue in arrival
+ * order. Must hold the run queue lock.
+ */
+static
+void
+thread_inbox_drain(void)
+{
+	struct thread *list, *t, *fifo;
+	uint32_t now;
+
+	KASSERT(spinlock_do_i_hold(&curcpu->c_runqueue_lock));
+
+	if (curcpu->c_inbox == NULL) {
+		return;
+	}
+	list = atomic_swap_ptr((void *volatile *)&curcpu->c_inbox, NULL);
+	/* Their wait for a cpu starts now, by this cpu's clock */
+	now = cpu_getcycles();
+
+	fifo = NULL;
+	while (list != NULL) {
+		t = list;
+		list = t->t_inboxnext;
+		t->t_inboxnext = fifo;
+		fifo = t;
+	}
+	while (fifo != NULL) {
+		t = fifo;
+		fifo = t->t_inboxnext;
+		t->t_inboxnext = NULL;
+		KASSERT(t->t_cpu == curcpu->c_self);
+		t->t_stamp = now;
+		thread_enqueue(&curcpu->c_runqueue, t);
+	}
+}
+
+/*
+ * Consolidation.
+ *
+ * When the system is lightly loaded, spreading threads evenly leaves
+ * every CPU a little busy and none of them idle for long. If the load
+ * (threads running plus threads on run queues) is at or below
+ * pack_threshold, we instead pack everything onto CPU 0 so the others
+ * can stay in cpu_idle(): other CPUs push their queued threads over,
+ * new threads start on CPU 0, and threads waking up on other CPUs are
+ * moved over as they wake. Once the load goes over the threshold,
+ * thread_consider_migration goes back to spreading.
+ *
+ * A thread that is running alone on another CPU can't be moved until
+ * it sleeps or has to share that CPU, because that CPU's idle loop
+ * runs on the stack of the last thread to run there. (This is also
+ * why migration never moves curthread.)
+ *
+ * pack_threshold is 0, which means never pack, until set from the
+ * menu.
+ */
+
+static unsigned pack_threshold;
+static volatile bool packing;
+
+void
+thread_setpackthreshold(unsigned load)
+{
+	pack_threshold = load;
+	if (load == 0) {
+		packing = false;
+	}
+}
+
+unsigned
+thread_getpackthreshold(void)
+{
+	return pack_threshold;
+}
+
+/*
+ * The cpu threads are packed onto.
+ */
+static
+struct cpu *
+thread_packcpu(void)
+{
+	return cpuarray_get(&allcpus, 0);
+}
+
+/*
+ * If we're packing, point T at the packing cpu before it's made
+ * runnable. T must be asleep (or new); if its old cpu is idling on
+ * its stack, it stays where it is.
+ */
+static
+void
+thread_packtarget(struct thread *t)
+{
+	struct cpu *old, *pc;
+
+	if (!packing) {
+		return;
+	}
+	pc = thread_packcpu();
+	old = t->t_cpu;
+	if (old == pc) {
+		return;
+	}
+	spinlock_acquire(&old->c_runqueue_lock);
+	if (old->c_curthread != t) {
+		t->t_cpu = pc;
+		schedtrace(STE_MIGRATE, t, pc->c_number, 0);
+	}
+	spinlock_release(&old->c_runqueue_lock);
+}
+
+/*
+ * Send everything on the current cpu's run queue to the packing cpu.
+ */
+static
+void
+thread_pack(void)
+{
+	struct cpu *pc;
+	struct thread *t, *keep;
+	struct threadlist victims;
+
+	pc = thread_packcpu();
+	if (pc == curcpu->c_self) {
+		return;
+	}
+
+	keep = NULL;
+	threadlist_init(&victims);
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	while ((t = threadlist_remhead(&curcpu->c_runqueue)) != NULL) {
+		/* curthread can be here; see thread_consider_migration */
+		if (t == curthread) {
+			keep = t;
+			continue;
+		}
+		threadlist_addtail(&victims, t);
+	}
+	if (keep != NULL) {
+		threadlist_addtail(&curcpu->c_runqueue, keep);
+	}
+	spinlock_release(&curcpu->c_runqueue_lock);
+
+	if (threadlist_isempty(&victims)) {
+		threadlist_cleanup(&victims);
+		return;
+	}
+
+	spinlock_acquire(&pc->c_runqueue_lock);
+	while ((t = threadlist_remhead(&victims)) != NULL) {
+		t->t_cpu = pc;
+		thread_enqueue(&pc->c_runqueue, t);
+		schedtrace(STE_MIGRATE, t, pc->c_number, 0);
+	}
+	if (pc->c_isidle) {
+		ipi_send(pc, IPI_UNIDLE);
+	}
+	spinlock_release(&pc->c_runqueue_lock);
+	threadlist_cleanup(&victims);
+}
+
 /*
  * Make a thread runnable.
  *
- * targetcpu might be curcpu; it might not be, too. 
+ * targetcpu might be curcpu; it might not be, too. If it isn't, and
+ * we aren't already holding its run queue lock, hand the thread over
+ * through the cpu's inbox rather than fighting the owner (and every
+ * other waker) for the lock.
  */
 static
 void
@@ -438,9 +807,20 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 	struct cpu *targetcpu;
 	bool isidle;
 
-	/* Lock the run queue of the target thread's cpu. */
 	targetcpu = target->t_cpu;
 
+	if (!already_have_lock) {
+		thread_packtarget(target);
+		targetcpu = target->t_cpu;
+		schedtrace(STE_WAKE, target, targetcpu->c_number, 0);
+	}
+
+	if (!already_have_lock && targetcpu != curcpu->c_self) {
+		thread_inbox_push(targetcpu, target, target);
+		return;
+	}
+
+	/* Lock the run queue of the target thread's cpu. */
 	if (already_have_lock) {
 		/* The target thread's cpu should be already locked. */
 		KASSERT(spinlock_do_i_hold(&targetcpu->c_runqueue_lock));
@@ -449,8 +829,15 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 		spinlock_acquire(&targetcpu->c_runqueue_lock);
 	}
 
+	/*
+	 * Start counting its wait for a cpu. (Threads sent through
+	 * the inbox get stamped when their cpu drains it, since each
+	 * cpu's cycle counter is its own.)
+	 */
+	target->t_stamp = cpu_getcycles();
+
 	isidle = targetcpu->c_isidle;
-	threadlist_addtail(&targetcpu->c_runqueue, target);
+	thread_enqueue(&targetcpu->c_runqueue, target);
 	if (isidle) {
 		/*
 		 * Other processor is idle; send interrupt to make
@@ -487,25 +874,32 @@ thread_fork(const char *name,
 	DEBUG(DB_THREADS,"Forking thread: %s\n",name);
 #endif // UW
 
-	newthread = thread_create(name);
+	newthread = thread_cache_get(name);
 	if (newthread == NULL) {
-		return ENOMEM;
-	}
+		newthread = thread_create(name);
+		if (newthread == NULL) {
+			return ENOMEM;
+		}
 
-	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
-	if (newthread->t_stack == NULL) {
-		thread_destroy(newthread);
-		return ENOMEM;
+		/* Allocate a stack */
+		newthread->t_stack = kmalloc(STACK_SIZE);
+		if (newthread->t_stack == NULL) {
+			thread_destroy(newthread);
+			return ENOMEM;
+		}
+		thread_checkstack_init(newthread);
 	}
-	thread_checkstack_init(newthread);
 
 	/*
 	 * Now we clone various fields from the parent thread.
 	 */
 
 	/* Thread subsystem fields */
-	newthread->t_cpu = curthread->t_cpu;
+	newthread->t_cpu = packing ? thread_packcpu() : curthread->t_cpu;
+
+	/* Start at the parent's own priority, not any donated one */
+	newthread->t_priority = curthread->t_basepriority;
+	newthread->t_basepriority = curthread->t_basepriority;
 
 	/* Attach the new thread to its process */
 	if (proc == NULL) {
@@ -548,6 +942,8 @@ void
 thread_switch(threadstate_t newstate, struct wchan *wc)
 {
 	struct thread *cur, *next;
+	uint32_t now;
+	bool idled;
 	int spl;
 
 	DEBUGASSERT(curcpu->c_curthread == curthread);
@@ -570,8 +966,9 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	/* Check the stack guard band. */
 	thread_checkstack(cur);
 
-	/* Lock the run queue. */
+	/* Lock the run queue, and pick up any remote wakeups. */
 	spinlock_acquire(&curcpu->c_runqueue_lock);
+	thread_inbox_drain();
 
 	/* Micro-optimization: if nothing to do, just return */
 	if (newstate == S_READY && threadlist_isempty(&curcpu->c_runqueue)) {
@@ -580,6 +977,19 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 		return;
 	}
 
+	/*
+	 * Settle our accounts before anyone can wake us up again.
+	 * Yielding from an interrupt means the timer preempted us.
+	 */
+	thread_chargetime(false);
+	if (newstate == S_SLEEP ||
+	    (newstate == S_READY && !cur->t_in_interrupt)) {
+		cur->t_usage.cu_nvcsw++;
+	}
+	else if (newstate == S_READY) {
+		cur->t_usage.cu_nivcsw++;
+	}
+
 	/* Put the thread in the right place. */
 	switch (newstate) {
 	    case S_RUN:
@@ -602,7 +1012,7 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 		 * or want it locked and if it does can lock it itself
 		 * without racing. Exercise: what's the other?)
 		 */
-		threadlist_addtail(&wc->wc_threads, cur);
+		thread_enqueue(&wc->wc_threads, cur);
 		wchan_unlock(wc);
 		break;
 	    case S_ZOMBIE:
@@ -631,15 +1041,26 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 
 	/* The current cpu is now idle. */
 	curcpu->c_isidle = true;
+	idled = false;
 	do {
+		thread_inbox_drain();
 		next = threadlist_remhead(&curcpu->c_runqueue);
 		if (next == NULL) {
 			spinlock_release(&curcpu->c_runqueue_lock);
+			schedtrace(STE_IDLE, cur, 0, 0);
+			now = cpu_getcycles();
 			cpu_idle();
+			curcpu->c_idlecycles +=
+				(uint32_t)(cpu_getcycles() - now);
+			idled = true;
+			schedtrace(STE_UNIDLE, cur, 0, 0);
 			spinlock_acquire(&curcpu->c_runqueue_lock);
 		}
 	} while (next == NULL);
 	curcpu->c_isidle = false;
+	if (idled) {
+		curcpu->c_idleperiods++;
+	}
 
 	/*
 	 * Note that curcpu->c_curthread may be the same variable as
@@ -648,6 +1069,19 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	 * assume the compiler will optimize one away if they're the
 	 * same.
 	 */
+	schedtrace(STE_SWITCH, cur, newstate, (uintptr_t)next);
+
+	/*
+	 * Charge NEXT for its time on the run queue. A thread that
+	 * migrated here was stamped by another cpu, whose counter
+	 * may be ahead of ours; don't charge it a negative wait.
+	 */
+	now = cpu_getcycles();
+	if ((int32_t)(now - next->t_stamp) > 0) {
+		next->t_usage.cu_waittime += (uint32_t)(now - next->t_stamp);
+	}
+	next->t_stamp = now;
+
 	curcpu->c_curthread = next;
 	curthread = next;
 
@@ -819,20 +1253,340 @@ thread_yield(void)
 
 ////////////////////////////////////////////////////////////
 
+/*
+ * Set the current thread's base priority.
+ */
+void
+thread_setpriority(int priority)
+{
+	KASSERT(priority >= PRI_MIN && priority <= PRI_MAX);
+
+	curthread->t_basepriority = priority;
+	/* Keep any donations from waiters on locks we hold. */
+	lock_updatepriority();
+	thread_yield();
+}
+
+/*
+ * Return the number of CPUs.
+ */
+unsigned
+thread_numcpus(void)
+{
+	return cpuarray_num(&allcpus);
+}
+
+void
+thread_chargetime(bool user)
+{
+	uint32_t now, delta;
+
+	now = cpu_getcycles();
+	delta = now - curthread->t_stamp;
+	if (user) {
+		curthread->t_usage.cu_utime += delta;
+	}
+	else {
+		curthread->t_usage.cu_stime += delta;
+	}
+	curthread->t_stamp = now;
+}
+
+void
+cpuusage_add(struct cpuusage *dest, const struct cpuusage *src)
+{
+	dest->cu_utime += src->cu_utime;
+	dest->cu_stime += src->cu_stime;
+	dest->cu_waittime += src->cu_waittime;
+	dest->cu_nvcsw += src->cu_nvcsw;
+	dest->cu_nivcsw += src->cu_nivcsw;
+}
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Gang scheduling.
+ *
+ * Jobs like psort and triplesort are several processes that
+ * synchronize often. Scheduled independently, one of them regularly
+ * blocks waiting on a partner that is sitting in another CPU's run
+ * queue. With gang scheduling on, the threads of one process group
+ * (a "gang") are favored on every CPU for a time slice, so the group
+ * runs all at once, and the favored gang rotates from slice to slice.
+ *
+ * CPU 0 picks the next gang halfway through each slice and spreads
+ * its members out so no CPU has two of them queued while another has
+ * none. Each CPU then puts the gang at the front of its run queue when
+ * it reshuffles at the slice boundary, and hardclock doesn't preempt a
+ * gang member until the slice ends. Group 0 (the kernel) is never a
+ * gang.
+ */
+
+static bool gang_enabled;
+static volatile pid_t gang_current;
+
+/*
+ * The gang a thread belongs to. Only safe for threads that can't
+ * exit underneath us: curthread, or threads on a run queue whose
+ * lock we hold.
+ */
+static
+pid_t
+thread_gang(struct thread *t)
+{
+#if OPT_A2
+	if (t->t_proc != NULL) {
+		return t->t_proc->p_pgid;
+	}
+#endif
+	(void)t;
+	return 0;
+}
+
+/*
+ * Like thread_enqueue, but members of GANG go ahead of non-members
+ * of the same priority.
+ */
+static
+void
+gang_enqueue(struct threadlist *tl, struct thread *t, pid_t gang)
+{
+	struct thread *prev;
+	bool member;
+
+	member = thread_gang(t) == gang;
+	THREADLIST_FORALL_REV(prev, *tl) {
+		if (prev->t_priority > t->t_priority ||
+		    (prev->t_priority == t->t_priority &&
+		     (!member || thread_gang(prev) == gang))) {
+			threadlist_insertafter(tl, prev, t);
+			return;
+		}
+	}
+	threadlist_addhead(tl, t);
+}
+
+/*
+ * Check if C has a member of GANG on its run queue. Call with the run
+ * queue locked.
+ */
+static
+bool
+gang_queued(struct cpu *c, pid_t gang)
+{
+	struct thread *t;
+
+	THREADLIST_FORALL(t, c->c_runqueue) {
+		if (t != c->c_curthread && thread_gang(t) == gang) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Sort TL by priority, stably, with the members of GANG (unless it's
+ * 0) ahead of everyone else of the same priority.
+ */
+void
+thread_gangsort(struct threadlist *tl, pid_t gang)
+{
+	struct threadlist sorted;
+	struct thread *t;
+
+	threadlist_init(&sorted);
+	while ((t = threadlist_remhead(tl)) != NULL) {
+		if (gang != 0) {
+			gang_enqueue(&sorted, t, gang);
+		}
+		else {
+			thread_enqueue(&sorted, t);
+		}
+	}
+	while ((t = threadlist_remhead(&sorted)) != NULL) {
+		threadlist_addtail(tl, t);
+	}
+	threadlist_cleanup(&sorted);
+}
+
+void
+thread_setgangsched(bool on)
+{
+	gang_enabled = on;
+	if (!on) {
+		gang_current = 0;
+	}
+}
+
+bool
+thread_ingang(void)
+{
+	pid_t gang;
+
+	gang = gang_current;
+	return gang_enabled && gang != 0 && thread_gang(curthread) == gang;
+}
+
+bool
+thread_higherqueued(void)
+{
+	struct thread *t;
+	bool found;
+
+	/*
+	 * The queue is in priority order (gang members only go ahead
+	 * of others of the same priority), so the first thread other
+	 * than us settles it; curthread can be queued here too, see
+	 * thread_consider_migration. Threads still in the inbox
+	 * aren't seen until the next switch drains it.
+	 */
+	found = false;
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	THREADLIST_FORALL(t, curcpu->c_runqueue) {
+		if (t != curthread) {
+			found = t->t_priority > curthread->t_priority;
+			break;
+		}
+	}
+	spinlock_release(&curcpu->c_runqueue_lock);
+	return found;
+}
+
+void
+thread_rotategang(void)
+{
+	unsigned i, numcpus, nempty;
+	struct cpu *c;
+	struct thread *t, *next;
+	struct threadlist extras;
+	pid_t cur, gang, first, g;
+	bool have;
+
+	if (!gang_enabled) {
+		return;
+	}
+
+	/*
+	 * Round-robin among the gangs that have threads waiting to
+	 * run: take the lowest group number above the current one,
+	 * or wrap around to the lowest.
+	 */
+	cur = gang_current;
+	gang = first = 0;
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		spinlock_acquire(&c->c_runqueue_lock);
+		THREADLIST_FORALL(t, c->c_runqueue) {
+			g = thread_gang(t);
+			if (g == 0) {
+				continue;
+			}
+			if (first == 0 || g < first) {
+				first = g;
+			}
+			if (g > cur && (gang == 0 || g < gang)) {
+				gang = g;
+			}
+		}
+		spinlock_release(&c->c_runqueue_lock);
+	}
+	if (gang == 0) {
+		gang = first;
+	}
+	gang_current = gang;
+	if (gang == 0 || packing) {
+		/* (Spreading would undo consolidation; see below.) */
+		return;
+	}
+
+	/*
+	 * Spread the gang out: count the CPUs with none of it queued,
+	 * take up to that many surplus members off CPUs that have
+	 * more than one, and hand them out. As in
+	 * thread_consider_migration, things can change while we
+	 * work; anything left over comes to this CPU.
+	 */
+	nempty = 0;
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		spinlock_acquire(&c->c_runqueue_lock);
+		if (!gang_queued(c, gang)) {
+			nempty++;
+		}
+		spinlock_release(&c->c_runqueue_lock);
+	}
+
+	threadlist_init(&extras);
+	for (i=0; i<numcpus && extras.tl_count < nempty; i++) {
+		c = cpuarray_get(&allcpus, i);
+		have = false;
+		spinlock_acquire(&c->c_runqueue_lock);
+		t = c->c_runqueue.tl_head.tln_next->tln_self;
+		while (t != NULL && extras.tl_count < nempty) {
+			next = t->t_listnode.tln_next->tln_self;
+			if (t != c->c_curthread && thread_gang(t) == gang) {
+				if (have) {
+					threadlist_remove(&c->c_runqueue, t);
+					threadlist_addtail(&extras, t);
+				}
+				have = true;
+			}
+			t = next;
+		}
+		spinlock_release(&c->c_runqueue_lock);
+	}
+
+	for (i=0; i<numcpus && !threadlist_isempty(&extras); i++) {
+		c = cpuarray_get(&allcpus, i);
+		spinlock_acquire(&c->c_runqueue_lock);
+		if (!gang_queued(c, gang)) {
+			t = threadlist_remhead(&extras);
+			t->t_cpu = c;
+			thread_enqueue(&c->c_runqueue, t);
+			schedtrace(STE_MIGRATE, t, c->c_number, 0);
+			if (c->c_isidle) {
+				ipi_send(c, IPI_UNIDLE);
+			}
+		}
+		spinlock_release(&c->c_runqueue_lock);
+	}
+
+	if (!threadlist_isempty(&extras)) {
+		spinlock_acquire(&curcpu->c_runqueue_lock);
+		while ((t = threadlist_remhead(&extras)) != NULL) {
+			t->t_cpu = curcpu->c_self;
+			thread_enqueue(&curcpu->c_runqueue, t);
+		}
+		spinlock_release(&curcpu->c_runqueue_lock);
+	}
+	threadlist_cleanup(&extras);
+}
+
+////////////////////////////////////////////////////////////
+
 /*
  * Scheduler.
  *
  * This is called periodically from hardclock(). It should reshuffle
  * the current CPU's run queue by job priority.
+ *
+ * Threads are queued by priority as they become runnable, but a
+ * thread's priority can be raised by lock donation while it sits on
+ * the queue; re-sort so such threads don't wait behind lower ones.
+ * Equal priorities keep their order, so this remains round-robin
+ * when nobody has changed priority.
+ *
+ * With gang scheduling on, members of the gang being favored also go
+ * ahead of everyone else of the same priority.
  */
-
 void
 schedule(void)
 {
-	/*
-	 * You can write this. If we do nothing, threads will run in
-	 * round-robin fashion.
-	 */
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	thread_gangsort(&curcpu->c_runqueue,
+			gang_enabled ? gang_current : 0);
+	spinlock_release(&curcpu->c_runqueue_lock);
 }
 
 /*
@@ -855,24 +1609,34 @@ schedule(void)
 void
 thread_consider_migration(void)
 {
-	unsigned my_count, total_count, one_share, to_send;
+	unsigned my_count, total_count, one_share, to_send, nrunning;
 	unsigned i, numcpus;
 	struct cpu *c;
 	struct threadlist victims;
 	struct thread *t;
 
-	my_count = total_count = 0;
+	my_count = total_count = nrunning = 0;
 	numcpus = cpuarray_num(&allcpus);
 	for (i=0; i<numcpus; i++) {
 		c = cpuarray_get(&allcpus, i);
 		spinlock_acquire(&c->c_runqueue_lock);
 		total_count += c->c_runqueue.tl_count;
+		if (!c->c_isidle) {
+			nrunning++;
+		}
 		if (c == curcpu->c_self) {
 			my_count = c->c_runqueue.tl_count;
 		}
 		spinlock_release(&c->c_runqueue_lock);
 	}
 
+	packing = pack_threshold > 0 &&
+		total_count + nrunning <= pack_threshold;
+	if (packing) {
+		thread_pack();
+		return;
+	}
+
 	one_share = DIVROUNDUP(total_count, numcpus);
 	if (my_count < one_share) {
 		return;
@@ -924,7 +1688,8 @@ thread_consider_migration(void)
 			}
 
 			t->t_cpu = c;
-			threadlist_addtail(&c->c_runqueue, t);
+			thread_enqueue(&c->c_runqueue, t);
+			schedtrace(STE_MIGRATE, t, c->c_number, 0);
 			DEBUG(DB_THREADS,
 			      "Migrated thread %s: cpu %u -> %u",
 			      t->t_name, curcpu->c_number, c->c_number);
@@ -948,7 +1713,7 @@ thread_consider_migration(void)
 	if (!threadlist_isempty(&victims)) {
 		spinlock_acquire(&curcpu->c_runqueue_lock);
 		while ((t = threadlist_remhead(&victims)) != NULL) {
-			threadlist_addtail(&curcpu->c_runqueue, t);
+			thread_enqueue(&curcpu->c_runqueue, t);
 		}
 		spinlock_release(&curcpu->c_runqueue_lock);
 	}
@@ -957,6 +1722,55 @@ thread_consider_migration(void)
 	threadlist_cleanup(&victims);
 }
 
+/*
+ * Print how much of the time since the last reset each cpu has spent
+ * in cpu_idle(), and how long it stayed there on average. (Elapsed
+ * time is counted in hardclock ticks, which idle cpus still take.)
+ */
+void
+thread_printidlestats(void)
+{
+	unsigned i, numcpus, permil, avgus;
+	struct cpu *c;
+	uint64_t idle, elapsed;
+
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		idle = c->c_idlecycles;
+		elapsed = (uint64_t)(c->c_hardclocks - c->c_idlesince) *
+			(CPU_CYCLES_PER_SEC / HZ);
+		permil = elapsed == 0 ? 0 : (unsigned)(idle * 1000 / elapsed);
+		avgus = c->c_idleperiods == 0 ? 0 :
+			(unsigned)(idle / c->c_idleperiods /
+				   (CPU_CYCLES_PER_SEC / 1000000));
+		kprintf("cpu%u: idle %u.%u%% of %u ms, %u periods, "
+			"average %u us\n", c->c_number,
+			permil / 10, permil % 10,
+			(unsigned)(elapsed / (CPU_CYCLES_PER_SEC / 1000)),
+			c->c_idleperiods, avgus);
+	}
+}
+
+/*
+ * Clear the idle statistics. Another cpu might be in the middle of
+ * adding to its count, so this is only approximate.
+ */
+void
+thread_resetidlestats(void)
+{
+	unsigned i, numcpus;
+	struct cpu *c;
+
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		c->c_idlecycles = 0;
+		c->c_idleperiods = 0;
+		c->c_idlesince = c->c_hardclocks;
+	}
+}
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -1029,9 +1843,10 @@ wchan_sleep(struct wchan *wc)
 }
 
 /*
- * Wake up one thread sleeping on a wait channel.
+ * Wake up one thread sleeping on a wait channel. Returns false if
+ * there wasn't one.
  */
-void
+bool
 wchan_wakeone(struct wchan *wc)
 {
 	struct thread *target;
@@ -1047,10 +1862,24 @@ wchan_wakeone(struct wchan *wc)
 
 	if (target == NULL) {
 		/* Nobody was sleeping. */
-		return;
+		return false;
 	}
 
 	thread_make_runnable(target, false);
+	return true;
+}
+
+/*
+ * Wake up a specific thread sleeping on a wait channel.
+ */
+void
+wchan_wakethread(struct wchan *wc, struct thread *t)
+{
+	spinlock_acquire(&wc->wc_lock);
+	threadlist_remove(&wc->wc_threads, t);
+	spinlock_release(&wc->wc_lock);
+
+	thread_make_runnable(t, false);
 }
 
 /*
@@ -1059,8 +1888,11 @@ wchan_wakeone(struct wchan *wc)
 void
 wchan_wakeall(struct wchan *wc)
 {
-	struct thread *target;
+	struct thread *target, *first, *last;
+	struct threadlistnode *tln, *next;
 	struct threadlist list;
+	struct cpu *c;
+	bool local, isidle;
 
 	threadlist_init(&list);
 
@@ -1078,18 +1910,115 @@ wchan_wakeall(struct wchan *wc)
 	 */
 	spinlock_release(&wc->wc_lock);
 
+	if (packing) {
+		THREADLIST_FORALL(target, list) {
+			thread_packtarget(target);
+		}
+	}
+
 	/*
-	 * We could conceivably sort by cpu first to cause fewer lock
-	 * ops and fewer IPIs, but for now at least don't bother. Just
-	 * make each thread runnable.
+	 * Hand the threads over one cpu at a time, so each run queue
+	 * lock is taken (or each inbox pushed to) and each IPI sent
+	 * at most once no matter how big the herd is. Each pass takes
+	 * the cpu of the first thread left on the list and pulls out
+	 * all the threads belonging to it, in order.
 	 */
 	while ((target = threadlist_remhead(&list)) != NULL) {
-		thread_make_runnable(target, false);
+		c = target->t_cpu;
+		schedtrace(STE_WAKE, target, c->c_number, 0);
+		first = last = NULL;
+		isidle = false;
+		local = (c == curcpu->c_self);
+		if (local) {
+			spinlock_acquire(&c->c_runqueue_lock);
+			isidle = c->c_isidle;
+			/* (the inbox ones get stamped by their cpu) */
+			target->t_stamp = cpu_getcycles();
+			thread_enqueue(&c->c_runqueue, target);
+		}
+		else {
+			/* Chain newest first, as the inbox wants it */
+			first = last = target;
+			last->t_inboxnext = NULL;
+		}
+
+		for (tln = list.tl_head.tln_next; tln->tln_next != NULL;
+		     tln = next) {
+			next = tln->tln_next;
+			target = tln->tln_self;
+			if (target->t_cpu != c) {
+				continue;
+			}
+			threadlist_remove(&list, target);
+			schedtrace(STE_WAKE, target, c->c_number, 0);
+			if (local) {
+				target->t_stamp = cpu_getcycles();
+				thread_enqueue(&c->c_runqueue, target);
+			}
+			else {
+				target->t_inboxnext = first;
+				first = target;
+			}
+		}
+
+		if (local) {
+			if (isidle) {
+				ipi_send(c, IPI_UNIDLE);
+			}
+			spinlock_release(&c->c_runqueue_lock);
+		}
+		else {
+			thread_inbox_push(c, first, last);
+		}
 	}
 
 	threadlist_cleanup(&list);
 }
 
+/*
+ * Move the first thread sleeping on FROM over to TO, where it keeps
+ * sleeping as if it had gone to sleep there. Returns the thread, or
+ * NULL if FROM was empty.
+ */
+struct thread *
+wchan_requeueone(struct wchan *from, struct wchan *to)
+{
+	struct thread *t;
+
+	spinlock_acquire(&from->wc_lock);
+	t = threadlist_remhead(&from->wc_threads);
+	if (t != NULL) {
+		spinlock_acquire(&to->wc_lock);
+		t->t_wchan_name = to->wc_name;
+		thread_enqueue(&to->wc_threads, t);
+		spinlock_release(&to->wc_lock);
+	}
+	spinlock_release(&from->wc_lock);
+	return t;
+}
+
+/*
+ * Return the highest priority of any thread sleeping on the channel.
+ * Scans the whole list because priorities can change during sleep.
+ */
+int
+wchan_maxpriority(struct wchan *wc, int lowest)
+{
+	struct thread *t;
+	int ret;
+
+	ret = lowest;
+	spinlock_acquire(&wc->wc_lock);
+	THREADLIST_FORALL(t, wc->wc_threads) {
+		if (t->t_priority > ret) {
+			ret = t->t_priority;
+		}
+	}
+	spinlock_release(&wc->wc_lock);
+
+	return ret;
+}
+
 /*
  * Return nonzero if there are no threads sleeping on the channel.
  * This is meant to be used only for diagnostic purposes.
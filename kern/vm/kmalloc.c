@@ -347,6 +347,16 @@ kheap_printstats(void)
 	spinlock_release(&kmalloc_spinlock);
 }
 
+/*
+ * Set up the heap's part in spinlock statistics. Called once during
+ * boot.
+ */
+void
+kheap_bootstrap(void)
+{
+	spinlock_stats_register(&kmalloc_spinlock, "kmalloc");
+}
+
 ////////////////////////////////////////
 
 static
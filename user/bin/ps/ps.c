@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+/*
+ * ps - list processes and the CPU time they have used.
+ * Usage: ps
+ *
+ * Walks the process table with the procinfo system call. For each
+ * process, shows its parent, whether it has exited (Z) or is still
+ * running (R), how many threads it has, its user and system time,
+ * the time its threads spent runnable but waiting for a CPU, and
+ * its voluntary and involuntary context switches.
+ */
+
+static
+void
+printtime(const struct timeval *tv)
+{
+	printf(" %5lu.%03lu", (unsigned long)tv->tv_sec,
+	       (unsigned long)tv->tv_usec / 1000);
+}
+
+int
+main(void)
+{
+	struct procinfo pi;
+	pid_t pid;
+
+	printf("  PID  PPID S THR      USER       SYS      WAIT"
+	       "   VCSW  IVCSW NAME\n");
+
+	pid = 0;
+	while (procinfo(pid, &pi) == 0) {
+		printf("%5d %5d %c %3u", pi.pi_pid, pi.pi_ppid,
+		       pi.pi_exited ? 'Z' : 'R', pi.pi_nthreads);
+		printtime(&pi.pi_utime);
+		printtime(&pi.pi_stime);
+		printtime(&pi.pi_waittime);
+		printf(" %6lu %6lu %s\n", (unsigned long)pi.pi_nvcsw,
+		       (unsigned long)pi.pi_nivcsw, pi.pi_name);
+		pid = pi.pi_pid + 1;
+	}
+	if (errno != ESRCH) {
+		err(1, "procinfo");
+	}
+	return 0;
+}
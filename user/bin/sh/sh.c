@@ -45,6 +45,7 @@
 #include <limits.h>
 #include <errno.h>
 #include <err.h>
+#include <spawn.h>
 
 #ifdef HOST
 #include "hostcompat.h"
@@ -307,7 +308,8 @@ docommand(char *buf)
 	int nargs, i;
 	char *s;
 	pid_t pid;
-	int status;
+	posix_spawnattr_t attr;
+	int status, result;
 	int bg=0;
 	time_t startsecs, endsecs;
 	unsigned long startnsecs, endnsecs;
@@ -354,29 +356,28 @@ docommand(char *buf)
 		__time(&startsecs, &startnsecs);
 	}
 
-	pid = fork();
-	switch (pid) {
-		case -1:
-			/* error */
-			warn("fork");
-			return _MKWAIT_EXIT(255);
-		case 0:
-			/* child */
-			execv(args[0], args);
-			warn("%s", args[0]);
-			/*
-			 * Use _exit() instead of exit() in the child
-			 * process to avoid calling atexit() functions,
-			 * which would cause hostcompat (if present) to
-			 * reset the tty state and mess up our input
-			 * handling.
-			 */
-			_exit(1);
-		default:
-			break;
-	}
-
-	/* parent */
+	/*
+	 * Start the command with posix_spawn rather than fork and
+	 * execv: nothing has to run in the child before the exec, and
+	 * this way the kernel doesn't copy the whole shell just to
+	 * throw the copy away again.
+	 *
+	 * Put each command in a process group of its own, so its
+	 * processes are scheduled as a gang when gang scheduling is on.
+	 * The kernel does that before the child runs, so it never runs
+	 * in the shell's group.
+	 */
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+	posix_spawnattr_setpgroup(&attr, 0);
+	result = posix_spawn(&pid, args[0], NULL, &attr, args, NULL);
+	posix_spawnattr_destroy(&attr);
+	if (result) {
+		errno = result;
+		warn("%s", args[0]);
+		return _MKWAIT_EXIT(255);
+	}
+
 	if (bg) {
 		/* background this command */
 		remember_bg(pid);
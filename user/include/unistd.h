@@ -42,6 +42,9 @@
 #include <kern/reboot.h>
 #include <kern/seek.h>
 #include <kern/time.h>
+#include <kern/resource.h>
+#include <kern/procinfo.h>
+#include <kern/ring.h>
 #include <kern/unistd.h>
 #include <kern/wait.h>
 
@@ -154,14 +157,41 @@ int dup2(int filehandle, int newhandle);
 int pipe(int filehandles[2]);
 time_t __time(time_t *seconds, unsigned long *nanoseconds);
 int __getcwd(char *buf, size_t buflen);
+int pread(int filehandle, void *buf, size_t size, off_t pos);
+int pwrite(int filehandle, const void *buf, size_t size, off_t pos);
+/* readv, writev - see sys/uio.h */
+pid_t getpgid(pid_t pid);
+int setpgid(pid_t pid, pid_t pgid);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
 
+/* Local extensions. */
+int futex_wait(volatile int *addr, int val);	/* sleep if *addr == val */
+int futex_wake(volatile int *addr, int count);	/* returns number woken */
+int __thread_create(void (*entry)(void (*)(void *), void *),
+		    void (*func)(void *), void *arg, void *stacktop);
+int thread_join(int tid, int *value);
+__DEAD void thread_exit(int value);
+int getrusage(int who, struct rusage *usage);
+int procinfo(pid_t pid, struct procinfo *info);	/* first pid >= PID */
+pid_t __spawn(const char *path, char *const argv[], pid_t pgid); /* see spawn.h */
+/* Copy LEN bytes between files in the kernel; NULL offsets use the seek position */
+ssize_t copy_file_range(int infd, off_t *inoff, int outfd, off_t *outoff,
+			size_t len, unsigned flags);
+int ring_enter(struct ring *ring, unsigned count);	/* see kern/ring.h */
+/* Asynchronous I/O: queue a transfer, get an id; aio_wait returns its count */
+int aio_read(int fd, void *buf, size_t len, off_t pos);
+int aio_write(int fd, const void *buf, size_t len, off_t pos);
+ssize_t aio_wait(int id);
+
 /*
  * These are not themselves system calls, but wrapper routines in libc.
  */
 
 char *getcwd(char *buf, size_t buflen);		/* calls __getcwd */
 time_t time(time_t *seconds);			/* calls __time */
+/* Run func(arg) in a new thread on the given stack; returns thread id */
+int thread_create(void (*func)(void *), void *arg,
+		  void *stack, size_t stacksize);	/* calls __thread_create */
 
 #endif /* _UNISTD_H_ */
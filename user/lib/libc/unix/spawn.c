@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <spawn.h>
+#include <unistd.h>
+
+/*
+ * posix_spawn: start PATH with arguments ARGV in a new process.
+ * Uses the OS/161 system call __spawn, which builds the child
+ * directly around the new program instead of forking a copy of us
+ * and then replacing it (and puts it in its process group first).
+ */
+int
+posix_spawn(pid_t *pid, const char *path,
+	    const posix_spawn_file_actions_t *file_actions,
+	    const posix_spawnattr_t *attrp,
+	    char *const argv[], char *const envp[])
+{
+	pid_t child, pgid;
+
+	(void)envp;
+
+	if (file_actions != NULL) {
+		return ENOSYS;
+	}
+	pgid = -1;
+	if (attrp != NULL && (attrp->psa_flags & POSIX_SPAWN_SETPGROUP)) {
+		pgid = attrp->psa_pgroup;
+	}
+
+	child = __spawn(path, argv, pgid);
+	if (child < 0) {
+		return errno;
+	}
+	if (pid != NULL) {
+		*pid = child;
+	}
+	return 0;
+}
+
+int
+posix_spawnattr_init(posix_spawnattr_t *attr)
+{
+	attr->psa_flags = 0;
+	attr->psa_pgroup = 0;
+	return 0;
+}
+
+int
+posix_spawnattr_destroy(posix_spawnattr_t *attr)
+{
+	(void)attr;
+	return 0;
+}
+
+int
+posix_spawnattr_setflags(posix_spawnattr_t *attr, short flags)
+{
+	if (flags & ~POSIX_SPAWN_SETPGROUP) {
+		return EINVAL;
+	}
+	attr->psa_flags = flags;
+	return 0;
+}
+
+int
+posix_spawnattr_setpgroup(posix_spawnattr_t *attr, pid_t pgroup)
+{
+	if (pgroup < 0) {
+		return EINVAL;
+	}
+	attr->psa_pgroup = pgroup;
+	return 0;
+}
@@ -0,0 +1,447 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * schedtrace - decode a scheduler trace written by the kernel's "st
+ * dump" menu command.
+ *
+ * Usage: schedtrace [-t] tracefile
+ *
+ * Prints, for each thread seen, how long it spent running, waiting
+ * on a run queue, and asleep; the idle time of each cpu; and a
+ * histogram of wakeup latency (from being made runnable to actually
+ * running). With -t, also prints every event as a timeline.
+ *
+ * The latency histogram only counts wakeups where the wake and the
+ * switch that followed were recorded on the same cpu; the others span
+ * two unsynchronized cycle counters and are only counted.
+ *
+ * Threads are identified by the address of their kernel thread
+ * structure.
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <err.h>
+
+#include "kern/schedtrace.h"
+
+#ifdef HOST
+
+#include <netinet/in.h> // for arpa/inet.h
+#include <arpa/inet.h>  // for ntohl
+#include "hostcompat.h"
+#define SWAPL(x) ntohl(x)
+#define SWAPS(x) ntohs(x)
+
+#else
+
+#define SWAPL(x) (x)
+#define SWAPS(x) (x)
+
+#endif
+
+/* Latency histogram buckets: <1us, <2us, <4us, ... */
+#define NBUCKETS 24
+
+/* What we know about a thread */
+enum tstate { T_UNKNOWN, T_RUN, T_READY, T_SLEEP, T_DEAD };
+
+struct tinfo {
+	uint32_t id;
+	enum tstate state;
+	uint64_t since;			/* when it entered STATE */
+	int woken;			/* READY because of a wakeup */
+	unsigned wakecpu;		/* cpu that recorded the wakeup */
+	uint64_t runtime, readytime, sleeptime;
+	unsigned switches, wakes, migrations;
+};
+
+/* A record with its time unwrapped to 64 bits */
+struct event {
+	uint64_t time;
+	struct schedtrace_record rec;
+};
+
+static struct event *events;
+static unsigned nevents;
+
+static struct tinfo **threads;
+static unsigned nthreads;
+
+static uint32_t cyclehz;
+static unsigned ncpus;
+static uint64_t *idletime, *idlesince;
+static uint64_t hist[NBUCKETS];
+static uint64_t crosswakes;		/* wakeups left out of hist */
+
+static
+void
+doread(FILE *f, void *buf, size_t len, const char *what)
+{
+	if (fread(buf, 1, len, f) != len) {
+		errx(1, "Truncated trace file (reading %s)", what);
+	}
+}
+
+/*
+ * Load the trace. Each cpu's records are oldest first; work back from
+ * the newest one, starting at the dump time, to turn the wrapping
+ * 32-bit timestamps into 64-bit ones. Each cpu's timestamps come from
+ * its own cycle counter, so this lines the cpus up only as well as
+ * their counters agree; see kern/schedtrace.h. Time 0 is placed far
+ * enough back not to go negative.
+ */
+static
+void
+loadtrace(const char *path)
+{
+	struct schedtrace_header sh;
+	struct schedtrace_record *recs;
+	uint32_t count, i, cpu, prev;
+	uint64_t t;
+	FILE *f;
+
+	f = fopen(path, "rb");
+	if (f == NULL) {
+		err(1, "%s", path);
+	}
+
+	doread(f, &sh, sizeof(sh), "header");
+	if (SWAPL(sh.sh_magic) != SCHEDTRACE_MAGIC) {
+		errx(1, "%s: Not a scheduler trace", path);
+	}
+	ncpus = SWAPL(sh.sh_ncpus);
+	cyclehz = SWAPL(sh.sh_cyclehz);
+	if (cyclehz == 0) {
+		errx(1, "%s: Bad cycle counter rate", path);
+	}
+
+	for (cpu=0; cpu<ncpus; cpu++) {
+		doread(f, &count, sizeof(count), "record count");
+		count = SWAPL(count);
+		if (count == 0) {
+			continue;
+		}
+		recs = malloc(count * sizeof(*recs));
+		events = realloc(events, (nevents + count) * sizeof(*events));
+		if (recs == NULL || events == NULL) {
+			errx(1, "Out of memory");
+		}
+		doread(f, recs, count * sizeof(*recs), "records");
+
+		prev = SWAPL(sh.sh_now);
+		t = (uint64_t)1 << 48;
+		for (i=count; i-- > 0; ) {
+			struct event *ev = &events[nevents + i];
+
+			ev->rec.sr_time = SWAPL(recs[i].sr_time);
+			ev->rec.sr_type = recs[i].sr_type;
+			ev->rec.sr_cpu = recs[i].sr_cpu;
+			ev->rec.sr_aux = SWAPS(recs[i].sr_aux);
+			ev->rec.sr_thread = SWAPL(recs[i].sr_thread);
+			ev->rec.sr_arg = SWAPL(recs[i].sr_arg);
+
+			t -= (uint32_t)(prev - ev->rec.sr_time);
+			prev = ev->rec.sr_time;
+			ev->time = t;
+		}
+		nevents += count;
+		free(recs);
+	}
+	fclose(f);
+}
+
+static
+int
+eventcmp(const void *a, const void *b)
+{
+	const struct event *ea = a, *eb = b;
+
+	if (ea->time != eb->time) {
+		return ea->time < eb->time ? -1 : 1;
+	}
+	/* Keep each cpu's own events in order */
+	if (ea->rec.sr_cpu != eb->rec.sr_cpu) {
+		return ea->rec.sr_cpu < eb->rec.sr_cpu ? -1 : 1;
+	}
+	return ea < eb ? -1 : (ea > eb);
+}
+
+static
+double
+usecs(uint64_t cycles)
+{
+	return cycles * 1000000.0 / cyclehz;
+}
+
+static
+struct tinfo *
+getthread(uint32_t id)
+{
+	unsigned i;
+
+	struct tinfo *t;
+
+	for (i=0; i<nthreads; i++) {
+		if (threads[i]->id == id) {
+			return threads[i];
+		}
+	}
+	t = calloc(1, sizeof(*t));
+	threads = realloc(threads, (nthreads + 1) * sizeof(*threads));
+	if (t == NULL || threads == NULL) {
+		errx(1, "Out of memory");
+	}
+	t->id = id;
+	t->state = T_UNKNOWN;
+	threads[nthreads++] = t;
+	return t;
+}
+
+/*
+ * Move thread T into state NEW at time NOW, charging the time since
+ * its last change to the state it was in.
+ */
+static
+void
+chstate(struct tinfo *t, enum tstate new, uint64_t now)
+{
+	uint64_t d = now - t->since;
+
+	switch (t->state) {
+	    case T_RUN: t->runtime += d; break;
+	    case T_READY: t->readytime += d; break;
+	    case T_SLEEP: t->sleeptime += d; break;
+	    default: break;
+	}
+	t->state = new;
+	t->since = now;
+}
+
+static
+void
+addlatency(uint64_t cycles)
+{
+	double us;
+	unsigned b;
+
+	us = usecs(cycles);
+	for (b=0; b < NBUCKETS-1 && us >= (double)(1U << b); b++) {
+		/* nothing */
+	}
+	hist[b]++;
+}
+
+static
+void
+replay(int timeline)
+{
+	struct schedtrace_record *sr;
+	struct tinfo *t, *next;
+	uint64_t now, start;
+	unsigned i;
+
+	idletime = calloc(ncpus, sizeof(*idletime));
+	idlesince = calloc(ncpus, sizeof(*idlesince));
+	if (idletime == NULL || idlesince == NULL) {
+		errx(1, "Out of memory");
+	}
+
+	start = nevents > 0 ? events[0].time : 0;
+	for (i=0; i<nevents; i++) {
+		sr = &events[i].rec;
+		now = events[i].time;
+		if (sr->sr_cpu >= ncpus) {
+			continue;
+		}
+
+		switch (sr->sr_type) {
+		    case STE_SWITCH:
+			t = getthread(sr->sr_thread);
+			next = getthread(sr->sr_arg);
+			t->switches++;
+			chstate(t, sr->sr_aux == STS_READY ? T_READY :
+				 sr->sr_aux == STS_SLEEP ? T_SLEEP : T_DEAD,
+				 now);
+			t->woken = 0;
+			if (next->state == T_READY && next->woken) {
+				if (next->wakecpu == sr->sr_cpu) {
+					addlatency(now - next->since);
+				}
+				else {
+					crosswakes++;
+				}
+			}
+			chstate(next, T_RUN, now);
+			if (timeline) {
+				printf("%12.1f cpu%u switch %08x -> %08x (%s)\n",
+				       usecs(now - start), sr->sr_cpu,
+				       t->id, next->id,
+				       sr->sr_aux == STS_READY ? "yield" :
+				       sr->sr_aux == STS_SLEEP ? "sleep" :
+				       "exit");
+			}
+			break;
+		    case STE_WAKE:
+			t = getthread(sr->sr_thread);
+			t->wakes++;
+			chstate(t, T_READY, now);
+			t->woken = 1;
+			t->wakecpu = sr->sr_cpu;
+			if (timeline) {
+				printf("%12.1f cpu%u wake %08x on cpu%u\n",
+				       usecs(now - start), sr->sr_cpu,
+				       t->id, sr->sr_aux);
+			}
+			break;
+		    case STE_MIGRATE:
+			t = getthread(sr->sr_thread);
+			t->migrations++;
+			if (timeline) {
+				printf("%12.1f cpu%u migrate %08x to cpu%u\n",
+				       usecs(now - start), sr->sr_cpu,
+				       t->id, sr->sr_aux);
+			}
+			break;
+		    case STE_IDLE:
+			idlesince[sr->sr_cpu] = now;
+			if (timeline) {
+				printf("%12.1f cpu%u idle\n",
+				       usecs(now - start), sr->sr_cpu);
+			}
+			break;
+		    case STE_UNIDLE:
+			if (idlesince[sr->sr_cpu] != 0) {
+				idletime[sr->sr_cpu] +=
+					now - idlesince[sr->sr_cpu];
+				idlesince[sr->sr_cpu] = 0;
+			}
+			if (timeline) {
+				printf("%12.1f cpu%u unidle\n",
+				       usecs(now - start), sr->sr_cpu);
+			}
+			break;
+		    default:
+			warnx("Unknown event type %u", sr->sr_type);
+			break;
+		}
+	}
+
+	/* Charge everyone up to the end of the trace */
+	if (nevents > 0) {
+		now = events[nevents-1].time;
+		for (i=0; i<nthreads; i++) {
+			chstate(threads[i], threads[i]->state, now);
+		}
+	}
+}
+
+static
+void
+report(void)
+{
+	struct tinfo *t;
+	uint64_t total, span;
+	unsigned i;
+
+	span = nevents > 0 ? events[nevents-1].time - events[0].time : 0;
+	printf("%u events over %.1f ms on %u cpus\n\n",
+	       nevents, usecs(span) / 1000.0, ncpus);
+
+	printf("thread     run(ms)  ready(ms)  sleep(ms) switches  "
+	       "wakes migrations\n");
+	for (i=0; i<nthreads; i++) {
+		t = threads[i];
+		printf("%08x %9.2f %10.2f %10.2f %8u %6u %10u\n",
+		       t->id, usecs(t->runtime) / 1000.0,
+		       usecs(t->readytime) / 1000.0,
+		       usecs(t->sleeptime) / 1000.0,
+		       t->switches, t->wakes, t->migrations);
+	}
+
+	printf("\ncpu  idle(ms)  idle%%\n");
+	for (i=0; i<ncpus; i++) {
+		printf("%3u %9.2f %6.1f\n", i, usecs(idletime[i]) / 1000.0,
+		       span > 0 ? 100.0 * idletime[i] / span : 0.0);
+	}
+
+	total = 0;
+	for (i=0; i<NBUCKETS; i++) {
+		total += hist[i];
+	}
+	printf("\nwakeup latency (%llu wakeups on the waking cpu; "
+	       "%llu across cpus not shown)\n",
+	       (unsigned long long)total, (unsigned long long)crosswakes);
+	for (i=0; i<NBUCKETS; i++) {
+		if (hist[i] == 0) {
+			continue;
+		}
+		if (i == NBUCKETS-1) {
+			printf("     >= %8u us", 1U << (i-1));
+		}
+		else {
+			printf("  < %11u us", 1U << i);
+		}
+		printf(" %8llu %5.1f%%\n", (unsigned long long)hist[i],
+		       100.0 * hist[i] / total);
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	int timeline = 0;
+	const char *path;
+
+#ifdef HOST
+	hostcompat_init(argc, argv);
+#endif
+
+	if (argc == 3 && !strcmp(argv[1], "-t")) {
+		timeline = 1;
+		path = argv[2];
+	}
+	else if (argc == 2) {
+		path = argv[1];
+	}
+	else {
+		errx(1, "Usage: schedtrace [-t] tracefile");
+	}
+
+	loadtrace(path);
+	qsort(events, nevents, sizeof(*events), eventcmp);
+	replay(timeline);
+	report();
+
+	return 0;
+}
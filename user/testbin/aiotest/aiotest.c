@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * aiotest - writes a file a block at a time with aio_write, filling
+ * in the next block while the last one is being written, then reads
+ * it back with two reads kept in flight while checking the blocks
+ * already in. Also checks the error cases.
+ *
+ * There is no remove system call, so the test file (aiotest.tmp) is left
+ * behind; the next run truncates and reuses it.
+ */
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <err.h>
+
+#define TESTFILE "aiotest.tmp"
+#define NBLOCKS 64
+#define BLOCKSIZE 4096
+
+static char wbuf[BLOCKSIZE];
+static char rbuf[2][BLOCKSIZE];
+
+static
+void
+fill(char *buf, int block)
+{
+	int i;
+
+	for (i=0; i<BLOCKSIZE; i++) {
+		buf[i] = (char)(block * 31 + i);
+	}
+}
+
+static
+void
+check(const char *buf, int block)
+{
+	int i;
+
+	for (i=0; i<BLOCKSIZE; i++) {
+		if (buf[i] != (char)(block * 31 + i)) {
+			errx(1, "block %d: wrong data at byte %d", block, i);
+		}
+	}
+}
+
+static
+void
+collect(int id, int block)
+{
+	ssize_t n;
+
+	n = aio_wait(id);
+	if (n < 0) {
+		err(1, "block %d: aio_wait", block);
+	}
+	if (n != BLOCKSIZE) {
+		errx(1, "block %d: short transfer (%d bytes)", block, (int)n);
+	}
+}
+
+int
+main(void)
+{
+	int fd, i, id, prev;
+	int ids[2];
+
+	fd = open(TESTFILE, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", TESTFILE);
+	}
+
+	/*
+	 * The data is copied in when the write is queued, so the one
+	 * buffer can be refilled while the write goes on.
+	 */
+	prev = -1;
+	for (i=0; i<NBLOCKS; i++) {
+		fill(wbuf, i);
+		id = aio_write(fd, wbuf, BLOCKSIZE, (off_t)i * BLOCKSIZE);
+		if (id < 0) {
+			err(1, "block %d: aio_write", i);
+		}
+		memset(wbuf, 0, BLOCKSIZE);
+		if (prev >= 0) {
+			collect(prev, i-1);
+		}
+		prev = id;
+	}
+	collect(prev, NBLOCKS-1);
+
+	/* two reads in flight; check one while the other goes on */
+	ids[0] = aio_read(fd, rbuf[0], BLOCKSIZE, 0);
+	if (ids[0] < 0) {
+		err(1, "block 0: aio_read");
+	}
+	for (i=0; i<NBLOCKS; i++) {
+		if (i+1 < NBLOCKS) {
+			ids[(i+1)%2] = aio_read(fd, rbuf[(i+1)%2], BLOCKSIZE,
+						(off_t)(i+1) * BLOCKSIZE);
+			if (ids[(i+1)%2] < 0) {
+				err(1, "block %d: aio_read", i+1);
+			}
+		}
+		collect(ids[i%2], i);
+		check(rbuf[i%2], i);
+	}
+
+	/* reading at the end of file gets nothing */
+	id = aio_read(fd, rbuf[0], BLOCKSIZE, (off_t)NBLOCKS * BLOCKSIZE);
+	if (id < 0) {
+		err(1, "aio_read at EOF");
+	}
+	if (aio_wait(id) != 0) {
+		errx(1, "aio_read at EOF returned data");
+	}
+
+	/* an id can only be collected once */
+	if (aio_wait(id) >= 0 || errno != EINVAL) {
+		errx(1, "aio_wait on a collected id: expected EINVAL");
+	}
+	if (aio_read(-1, rbuf[0], BLOCKSIZE, 0) >= 0 || errno != EBADF) {
+		errx(1, "aio_read on a bad fd: expected EBADF");
+	}
+	if (aio_write(STDOUT_FILENO, wbuf, 1, 0) >= 0 || errno != ESPIPE) {
+		errx(1, "aio_write on the console: expected ESPIPE");
+	}
+
+	close(fd);
+	printf("aiotest: passed\n");
+	return 0;
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * futextest - basic checks of futex_wait and futex_wake.
+ *
+ * First the cases that return straight away: waiting on a value that
+ * has already changed, waking with nobody asleep, and misaligned
+ * addresses. Then a second thread sleeps on a word until the main
+ * thread changes it and wakes it up.
+ */
+
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <err.h>
+
+#define STACKSIZE 8192
+
+static volatile int word;
+static volatile int flag;
+static char stack[STACKSIZE] __attribute__((__aligned__(8)));
+
+static
+void
+waiter(void *junk)
+{
+	(void)junk;
+
+	while (flag == 0) {
+		futex_wait(&flag, 0);
+	}
+	thread_exit(flag);
+}
+
+int
+main(void)
+{
+	int result, tid, value;
+	volatile int i;
+
+	word = 1;
+
+	result = futex_wait(&word, 0);
+	if (result != -1 || errno != EAGAIN) {
+		errx(1, "futex_wait on changed value: got %d, errno %d",
+		     result, errno);
+	}
+
+	result = futex_wake(&word, 1);
+	if (result != 0) {
+		errx(1, "futex_wake with no waiters returned %d", result);
+	}
+
+	result = futex_wake((volatile int *)((char *)&word + 1), 1);
+	if (result != -1 || errno != EINVAL) {
+		errx(1, "futex_wake on misaligned address: got %d, errno %d",
+		     result, errno);
+	}
+
+	flag = 0;
+	tid = thread_create(waiter, NULL, stack, STACKSIZE);
+	if (tid < 0) {
+		err(1, "thread_create");
+	}
+	/* let it get to sleep (it works either way) */
+	for (i=0; i<100000; i++) {
+		/* spin */
+	}
+	flag = 7;
+	futex_wake(&flag, 1);
+	if (thread_join(tid, &value) < 0) {
+		err(1, "thread_join");
+	}
+	if (value != 7) {
+		errx(1, "waiter thread exited with %d, expected 7", value);
+	}
+
+	printf("futextest: passed\n");
+	return 0;
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * iovtest - checks readv/writev and pread/pwrite: gathered writes
+ * land in order, positional I/O doesn't move the seek position, and
+ * the obvious error cases fail the way they should.
+ *
+ * There is no remove system call, so the test file (iovtest.tmp) is left
+ * behind; the next run truncates and reuses it.
+ */
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <err.h>
+
+#define TESTFILE "iovtest.tmp"
+
+static const char header[] = "HDR:";
+static const char payload[] = "the quick brown fox";
+
+static
+void
+checkpos(int fd, off_t want)
+{
+	off_t pos;
+
+	pos = lseek(fd, 0, SEEK_CUR);
+	if (pos != want) {
+		errx(1, "seek position is %ld, expected %ld",
+		     (long)pos, (long)want);
+	}
+}
+
+int
+main(void)
+{
+	struct iovec iov[2];
+	char hbuf[sizeof(header) - 1], pbuf[sizeof(payload) - 1];
+	size_t hlen = sizeof(hbuf), plen = sizeof(pbuf);
+	int fd, r;
+
+	fd = open(TESTFILE, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", TESTFILE);
+	}
+
+	/* header and payload in one call */
+	iov[0].iov_base = (void *)header;
+	iov[0].iov_len = hlen;
+	iov[1].iov_base = (void *)payload;
+	iov[1].iov_len = plen;
+	r = writev(fd, iov, 2);
+	if (r < 0) {
+		err(1, "writev");
+	}
+	if ((size_t)r != hlen + plen) {
+		errx(1, "writev: short count %d", r);
+	}
+	checkpos(fd, hlen + plen);
+
+	/* pread the payload; the position stays put */
+	memset(pbuf, 0, plen);
+	r = pread(fd, pbuf, plen, hlen);
+	if (r < 0) {
+		err(1, "pread");
+	}
+	if ((size_t)r != plen || memcmp(pbuf, payload, plen) != 0) {
+		errx(1, "pread: wrong data");
+	}
+	checkpos(fd, hlen + plen);
+
+	/* pwrite over the first byte of the header */
+	r = pwrite(fd, "h", 1, 0);
+	if (r != 1) {
+		err(1, "pwrite");
+	}
+	checkpos(fd, hlen + plen);
+
+	/* and scatter it all back */
+	if (lseek(fd, 0, SEEK_SET) != 0) {
+		err(1, "lseek");
+	}
+	iov[0].iov_base = hbuf;
+	iov[1].iov_base = pbuf;
+	r = readv(fd, iov, 2);
+	if (r < 0) {
+		err(1, "readv");
+	}
+	if ((size_t)r != hlen + plen ||
+	    hbuf[0] != 'h' || memcmp(hbuf + 1, header + 1, hlen - 1) != 0 ||
+	    memcmp(pbuf, payload, plen) != 0) {
+		errx(1, "readv: wrong data");
+	}
+	checkpos(fd, hlen + plen);
+
+	/* errors */
+	r = readv(fd, iov, 0);
+	if (r >= 0 || errno != EINVAL) {
+		errx(1, "readv with no buffers: expected EINVAL");
+	}
+	r = pread(STDIN_FILENO, pbuf, 1, 0);
+	if (r >= 0 || errno != ESPIPE) {
+		errx(1, "pread on the console: expected ESPIPE");
+	}
+	r = pwrite(fd, "x", 1, -1);
+	if (r >= 0 || errno != EINVAL) {
+		errx(1, "pwrite at a negative offset: expected EINVAL");
+	}
+
+	close(fd);
+	printf("iovtest: passed\n");
+	return 0;
+}
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * ringtest - writes a file in small records through the submission
+ * ring, syncs it, and reads it back the same way, checking the
+ * completions and the data. Also checks that a full completion queue
+ * holds submissions back.
+ *
+ * There is no remove system call, so the test file (ringtest.tmp) is left
+ * behind; the next run truncates and reuses it.
+ */
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <err.h>
+
+#define TESTFILE "ringtest.tmp"
+#define NRECS 100
+#define RECSIZE 16
+
+static struct ring ring;
+static char recs[NRECS][RECSIZE];
+static char back[NRECS][RECSIZE];
+
+static
+void
+submit(int op, int fd, void *buf, size_t len, off_t off, unsigned tag)
+{
+	struct ring_sqe *sqe;
+
+	if (ring.r_idx.sq_tail - ring.r_idx.sq_head == RING_ENTRIES) {
+		errx(1, "submission queue full");
+	}
+	sqe = &ring.r_sq[ring.r_idx.sq_tail % RING_ENTRIES];
+	sqe->rs_op = op;
+	sqe->rs_fd = fd;
+	sqe->rs_buf = buf;
+	sqe->rs_len = len;
+	sqe->rs_off = off;
+	sqe->rs_user_data = tag;
+	ring.r_idx.sq_tail++;
+}
+
+/*
+ * Submit everything queued and check each completion came back with
+ * the expected result, in order starting from tag FIRSTTAG.
+ */
+static
+void
+flush(unsigned firsttag, int want)
+{
+	struct ring_cqe *cqe;
+	unsigned tag = firsttag;
+	int n;
+
+	while (ring.r_idx.sq_head != ring.r_idx.sq_tail) {
+		n = ring_enter(&ring, 0);
+		if (n < 0) {
+			err(1, "ring_enter");
+		}
+		while (ring.r_idx.cq_head != ring.r_idx.cq_tail) {
+			cqe = &ring.r_cq[ring.r_idx.cq_head % RING_ENTRIES];
+			if (cqe->rc_user_data != tag) {
+				errx(1, "completion %u out of order (got %u)",
+				     tag, cqe->rc_user_data);
+			}
+			if (cqe->rc_res != want) {
+				errx(1, "request %u: result %d, expected %d",
+				     tag, cqe->rc_res, want);
+			}
+			ring.r_idx.cq_head++;
+			tag++;
+		}
+	}
+}
+
+int
+main(void)
+{
+	int fd, i, n;
+
+	for (i=0; i<NRECS; i++) {
+		snprintf(recs[i], RECSIZE, "record %d", i);
+	}
+
+	fd = open(TESTFILE, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", TESTFILE);
+	}
+
+	/* appending writes at the seek position, a batch at a time */
+	for (i=0; i<NRECS; i++) {
+		submit(RING_WRITE, fd, recs[i], RECSIZE, RING_OFF_CUR, i);
+		if ((i+1) % RING_ENTRIES == 0) {
+			flush(i+1 - RING_ENTRIES, RECSIZE);
+		}
+	}
+	flush(NRECS - NRECS % RING_ENTRIES, RECSIZE);
+	submit(RING_FSYNC, fd, NULL, 0, 0, 0);
+	flush(0, 0);
+
+	/* positional reads, backwards for good measure */
+	for (i=0; i<NRECS; i++) {
+		submit(RING_READ, fd, back[NRECS-1-i], RECSIZE,
+		       (off_t)(NRECS-1-i) * RECSIZE, i);
+		if ((i+1) % RING_ENTRIES == 0) {
+			flush(i+1 - RING_ENTRIES, RECSIZE);
+		}
+	}
+	flush(NRECS - NRECS % RING_ENTRIES, RECSIZE);
+	if (memcmp(recs, back, sizeof(recs)) != 0) {
+		errx(1, "read back the wrong data");
+	}
+
+	/* errors come back in the completion */
+	submit(RING_READ, -1, back[0], RECSIZE, RING_OFF_CUR, 0);
+	flush(0, -EBADF);
+
+	/* with the completion queue full, nothing more is taken */
+	for (i=0; i<RING_ENTRIES; i++) {
+		submit(RING_NOP, fd, NULL, 0, 0, i);
+	}
+	n = ring_enter(&ring, 0);
+	if (n != RING_ENTRIES) {
+		errx(1, "ring_enter took %d of %d", n, RING_ENTRIES);
+	}
+	submit(RING_NOP, fd, NULL, 0, 0, 0);
+	n = ring_enter(&ring, 0);
+	if (n >= 0 || errno != EBUSY) {
+		errx(1, "ring_enter with no completion room: expected EBUSY");
+	}
+
+	close(fd);
+	printf("ringtest: passed\n");
+	return 0;
+}
@@ -32,17 +32,10 @@
  * forks 3 threads off 2 to functions, each of which displays a string
  * every once in a while.
  *
- * This won't do much of anything unless you implement user-level
- * threads.
- *
- * It also makes various assumptions about the thread API. In
- * particular, it believes (1) that you create a thread by calling
- * "threadfork()" and passing the address for execution of the new
- * thread to begin at, (2) that if the parent thread exits any child
- * threads will keep running, and (3) child threads will exit if they
- * return from the function they started in. If any or all of these
- * assumptions are not met by your user-level threads, you will need
- * to patch this test accordingly.
+ * Threads are made with thread_create(), which runs a function on a
+ * stack we supply. If the parent thread exits, the child threads keep
+ * running, and child threads exit if they return from the function
+ * they started in; the process exits when the last thread does.
  *
  * This is also a rather basic test and you'll probably want to write
  * some more of your own.
@@ -54,6 +47,7 @@
 
 #define NTHREADS  3
 #define MAX       1<<25
+#define STACKSIZE 8192
 
 /* counter for the loop in the threads : 
    This variable is shared and incremented by each 
@@ -61,8 +55,11 @@
 volatile int count = 0;
 
 /* the 2 threads : */
-void ThreadRunner(void);
-void BladeRunner(void);
+void ThreadRunner(void *);
+void BladeRunner(void *);
+
+/* a stack for each */
+static char stacks[NTHREADS][STACKSIZE] __attribute__((__aligned__(8)));
 
 int
 main(int argc, char *argv[])
@@ -74,9 +71,9 @@ main(int argc, char *argv[])
 
     for (i=0; i<NTHREADS; i++) {
 	if (i)
-	    threadfork(ThreadRunner);
+	    thread_create(ThreadRunner, NULL, stacks[i], STACKSIZE);
         else
-	    threadfork(BladeRunner);
+	    thread_create(BladeRunner, NULL, stacks[i], STACKSIZE);
     }
 
     printf("Parent has left.\n");
@@ -89,8 +86,10 @@ main(int argc, char *argv[])
 */
 
 void
-BladeRunner()
+BladeRunner(void *junk)
 {
+    (void)junk;
+
     while (count < MAX) {
 	if (count % 500 == 0)
 	    printf("Blade ");
@@ -99,8 +98,10 @@ BladeRunner()
 }
 
 void
-ThreadRunner()
+ThreadRunner(void *junk)
 {
+    (void)junk;
+
     while (count < MAX) {
 	if (count % 513 == 0)
 	    printf(" Runner\n");
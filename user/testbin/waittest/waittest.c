@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * waittest - checks of waitpid beyond waiting for one known child:
+ * WNOHANG, waiting for any child (pid -1), waiting for any child in
+ * our process group (pid 0), and ECHILD when there is nothing left
+ * to wait for.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <err.h>
+
+#define NKIDS 3
+
+static
+pid_t
+spawn(int code, int spin)
+{
+	pid_t pid;
+	volatile int i;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		for (i=0; i<spin; i++) {
+			/* spin */
+		}
+		_exit(code);
+	}
+	return pid;
+}
+
+static
+void
+expect_echild(pid_t pid, const char *what)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) != -1 || errno != ECHILD) {
+		errx(1, "%s: expected ECHILD (errno %d)", what, errno);
+	}
+}
+
+int
+main(void)
+{
+	pid_t pids[NKIDS], pid;
+	int seen[NKIDS];
+	int status, i, j;
+
+	expect_echild(-1, "wait for any with no children");
+	expect_echild(getpid(), "wait for self");
+
+	/* WNOHANG on a child that's still going returns 0 */
+	pid = spawn(3, 2000000);
+	if (waitpid(pid, &status, WNOHANG) != 0) {
+		/* it can finish first on a fast machine; not an error */
+		warnx("child exited before WNOHANG check");
+	}
+	else if (waitpid(pid, &status, 0) != pid) {
+		err(1, "waitpid after WNOHANG");
+	}
+	else if (!WIFEXITED(status) || WEXITSTATUS(status) != 3) {
+		errx(1, "child status 0x%x, expected exit 3", status);
+	}
+
+	/* wait for any child collects each exactly once */
+	for (i=0; i<NKIDS; i++) {
+		pids[i] = spawn(10 + i, 1000 * i);
+		seen[i] = 0;
+	}
+	for (i=0; i<NKIDS; i++) {
+		pid = waitpid(-1, &status, 0);
+		if (pid < 0) {
+			err(1, "waitpid -1");
+		}
+		for (j=0; j<NKIDS && pids[j] != pid; j++) {
+			/* nothing */
+		}
+		if (j == NKIDS || seen[j]) {
+			errx(1, "waitpid -1 returned unexpected pid %d", pid);
+		}
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 10 + j) {
+			errx(1, "child %d status 0x%x", pid, status);
+		}
+		seen[j] = 1;
+	}
+	expect_echild(-1, "wait for any after reaping all");
+
+	/* pid 0: children inherit our process group */
+	pid = spawn(5, 0);
+	if (waitpid(0, &status, 0) != pid) {
+		err(1, "waitpid 0");
+	}
+
+	if (waitpid(-1, &status, WNOHANG) != -1 || errno != ECHILD) {
+		errx(1, "WNOHANG with no children: expected ECHILD");
+	}
+
+	printf("waittest: passed\n");
+	return 0;
+}